@@ -0,0 +1,222 @@
+/*
+
+   Simple 2D array used for frame and result storage
+
+   Rows start on cache line boundaries, and an optional guard band of
+   pixels around the array lets kernels write past the edges without
+   checking. The left guard is rounded up to whole cache lines so the
+   rows stay aligned with it. Memory is kept when the array shrinks, and isn't cleared
+   on a resize, call zero() when that's wanted.
+
+*/
+
+#ifndef __ARRAY2D__
+#define __ARRAY2D__
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+template<class T>
+class Array2D
+{
+public:
+
+	static const size_t	Alignment = 64;
+
+	Array2D()
+	{
+		width = height = 0;
+		pitch = 0;
+		guard = 0;
+		mem = nullptr;
+		data = nullptr;
+		capacity = 0;
+		external = false;
+	}
+
+	~Array2D()
+	{
+		release();
+	}
+
+	Array2D(const Array2D&) = delete;
+	Array2D& operator=(const Array2D&) = delete;
+
+	// true when the size changed, the contents are then undefined
+	bool
+	setSize(int w, int h, int g = 0)
+	{
+		if (w == width && h == height && g == guard && !external)
+			return false;
+
+		if (external)
+		{
+			mem = nullptr;
+			capacity = 0;
+			external = false;
+		}
+
+		width = w;
+		height = h;
+		guard = g;
+
+		if (!w && !h)
+		{
+			release();
+			pitch = 0;
+			return true;
+		}
+
+		// whole cache lines per row and before it when they divide evenly into T
+		int		left = g;
+		pitch = w + 2*g;
+		if (Alignment % sizeof(T) == 0)
+		{
+			int		perLine = (int)(Alignment / sizeof(T));
+			left = (g + perLine - 1) / perLine * perLine;
+			pitch = (left + w + g + perLine - 1) / perLine * perLine;
+		}
+
+		size_t	size = (size_t)pitch * (h + 2*g);
+
+		if (size > capacity)
+		{
+			release();
+			mem = (T*)allocate(size * sizeof(T));
+			capacity = size;
+		}
+
+		data = mem + (size_t)g * pitch + left;
+		return true;
+	}
+
+	// use someone else's memory until the next setSize()
+	void
+	setExternal(T* ext, int w, int h)
+	{
+		release();
+
+		width = w;
+		height = h;
+		pitch = w;
+		guard = 0;
+		mem = data = ext;
+		external = true;
+	}
+
+	// clears the guard band too
+	void
+	zero()
+	{
+		if (!mem)
+			return;
+
+		if (external)
+			memset(mem, 0, (size_t)pitch * height * sizeof(T));
+		else
+			memset(mem, 0, (size_t)pitch * (height + 2*guard) * sizeof(T));
+	}
+
+	T&
+	operator()(int x, int y)
+	{
+		return data[y*pitch + x];
+	}
+
+	const T&
+	operator()(int x, int y) const
+	{
+		return data[y*pitch + x];
+	}
+
+	// element (0, 0), rows are getPitch() elements apart
+	T*
+	getData()
+	{
+		return data;
+	}
+
+	int
+	getWidth() const
+	{
+		return width;
+	}
+
+	int
+	getHeight() const
+	{
+		return height;
+	}
+
+	int
+	getPitch() const
+	{
+		return pitch;
+	}
+
+	// pixels each side that can be written past the edges
+	int
+	getGuard() const
+	{
+		return guard;
+	}
+
+private:
+
+	static void*
+	allocate(size_t bytes)
+	{
+		void*	p;
+
+	#ifdef _WIN32
+		p = _aligned_malloc(bytes, Alignment);
+	#else
+		if (posix_memalign(&p, Alignment, bytes))
+			p = nullptr;
+	#endif
+
+		if (!p)
+			throw std::bad_alloc();
+		return p;
+	}
+
+	static void
+	deallocate(void* p)
+	{
+	#ifdef _WIN32
+		_aligned_free(p);
+	#else
+		free(p);
+	#endif
+	}
+
+	void
+	release()
+	{
+		if (mem && !external)
+			deallocate(mem);
+
+		mem = data = nullptr;
+		capacity = 0;
+		external = false;
+	}
+
+	T*			mem;			// allocation, guard band included
+	T*			data;			// element (0, 0)
+	size_t		capacity;		// elements allocated
+	int			width;
+	int			height;
+	int			pitch;			// elements per row
+	int			guard;
+	bool		external;		// mem isn't ours to delete
+
+};
+
+#endif
@@ -0,0 +1,204 @@
+/*
+
+   Audio for MovieCart fields
+
+*/
+
+#include "AudioEncoder.h"
+#include "ColorKernels.h"
+
+#include <math.h>
+#include <string.h>
+
+
+static const double	Pi = 3.14159265358979323846;
+
+// zero crossings of the sinc either side of the centre
+static const int	SincLobes = 8;
+
+// level of silence and the levels either side of it used for full scale,
+// the same 8 MVCWriter writes when there's no audio
+static const float	AudioCentre = 8.0f;
+static const float	AudioScale = 7.0f;
+
+
+AudioEncoder::AudioEncoder()
+{
+	myLines = 0;
+	myShaping = AudioShaping_First;
+	myHalfTaps = 0;
+	myNumTaps = 0;
+	myStep = 0;
+	myPos = 0;
+	myError[0] = myError[1] = 0.0f;
+}
+
+void
+AudioEncoder::setup(double inputRate, int linesPerField, double fieldRate, int shaping)
+{
+	double	step = inputRate / (linesPerField * fieldRate);
+
+	myLines = linesPerField;
+	myShaping = shaping;
+	myStep = (uint64_t)(step * 4294967296.0 + 0.5);
+
+	// a little under the lower of the two nyquists, in input cycles a sample
+	makeTaps(0.45 * (step > 1.0 ? 1.0 / step : 1.0));
+
+	// history of silence, the first output is on the first input sample
+	myInput.assign(myHalfTaps, 0.0f);
+	myPos = (uint64_t)myHalfTaps << 32;
+
+	myError[0] = myError[1] = 0.0f;
+}
+
+// Blackman windowed sinc, one set of taps for each fraction of an input
+// sample the output can fall at, each adding up to 1
+
+void
+AudioEncoder::makeTaps(double cutoff)
+{
+	myHalfTaps = (int)ceil(SincLobes / (2.0 * cutoff));
+	myNumTaps = (2 * myHalfTaps + 7) & ~7;
+	myTaps.assign(NumPhases * myNumTaps, 0.0f);
+
+	for (int p=0; p<NumPhases; p++)
+	{
+		float*	taps = &myTaps[p * myNumTaps];
+		double	frac = (double)p / NumPhases;
+		double	total = 0.0;
+
+		for (int k=0; k<myNumTaps; k++)
+		{
+			double	d = k - myHalfTaps + 1 - frac;
+
+			if (fabs(d) >= myHalfTaps)
+				continue;
+
+			double	x = 2.0 * cutoff * d;
+			double	sinc = x == 0.0 ? 1.0 : sin(Pi * x) / (Pi * x);
+			double	window = 0.42 + 0.5 * cos(Pi * d / myHalfTaps) + 0.08 * cos(2.0 * Pi * d / myHalfTaps);
+
+			taps[k] = (float)(sinc * window);
+			total += taps[k];
+		}
+
+		for (int k=0; k<myNumTaps; k++)
+			taps[k] = (float)(taps[k] / total);
+	}
+}
+
+void
+AudioEncoder::push(const float *samples, int count, int channels)
+{
+	size_t	size = myInput.size();
+
+	myInput.resize(size + count);
+
+	float*	dst = &myInput[size];
+
+	if (channels == 1)
+	{
+		memcpy(dst, samples, count * sizeof(float));
+		return;
+	}
+
+	float	scale = 1.0f / channels;
+
+	for (int i=0; i<count; i++, samples += channels)
+	{
+		float	sum = 0.0f;
+
+		for (int c=0; c<channels; c++)
+			sum += samples[c];
+
+		dst[i] = sum * scale;
+	}
+}
+
+int
+AudioEncoder::getInputNeeded() const
+{
+	if (!myLines)
+		return 0;
+
+	// the field's last output, at its nearest phase
+	uint64_t	last = myPos + (myLines - 1) * myStep + (1u << 23);
+	int64_t		end = (int64_t)(last >> 32) - myHalfTaps + myNumTaps + 1;
+	int64_t		needed = end - (int64_t)myInput.size();
+
+	return needed > 0 ? (int)needed : 0;
+}
+
+bool
+AudioEncoder::encodeField(uint8_t *dst)
+{
+	if (!myLines || getInputNeeded())
+		return false;
+
+	for (int i=0; i<myLines; i++, myPos += myStep)
+	{
+		uint64_t	pos = myPos + (1u << 23);
+		int			index = (int)(pos >> 32);
+		int			phase = (int)(pos >> 24) & (NumPhases - 1);
+
+		float	x = dotProduct(&myInput[index - myHalfTaps + 1], &myTaps[phase * myNumTaps], myNumTaps);
+		float	v = AudioCentre + AudioScale * x;
+
+		// take the earlier errors out, what's left is noise through (1 - z^-1)^n
+		if (myShaping == AudioShaping_First)
+			v -= myError[0];
+		else if (myShaping == AudioShaping_Second)
+			v -= 2.0f * myError[0] - myError[1];
+
+		float	q = floorf(v + 0.5f);
+		if (q < 0.0f)
+			q = 0.0f;
+		if (q > 15.0f)
+			q = 15.0f;
+
+		// clipped errors would keep growing
+		float	e = q - v;
+		if (e < -1.0f)
+			e = -1.0f;
+		if (e > 1.0f)
+			e = 1.0f;
+
+		myError[1] = myError[0];
+		myError[0] = e;
+
+		dst[i] = (uint8_t)q;
+	}
+
+	// keep what the next field's first taps reach back to
+	int		used = (int)(myPos >> 32) - myHalfTaps;
+
+	if (used > 0)
+	{
+		myInput.erase(myInput.begin(), myInput.begin() + used);
+		myPos -= (uint64_t)used << 32;
+	}
+
+	return true;
+}
+
+void
+AudioEncoder::flush()
+{
+	myInput.resize(myInput.size() + getInputNeeded(), 0.0f);
+}
+
+void
+AudioEncoder::dropBacklog(int maxFields)
+{
+	int64_t		ahead = (int64_t)myInput.size() - (int64_t)(myPos >> 32) - myHalfTaps;
+	int64_t		keep = (int64_t)((maxFields * myLines * (double)myStep) / 4294967296.0);
+
+	if (ahead <= keep)
+		return;
+
+	// jumps ahead to the newest input, the history goes with it
+	int64_t		drop = ahead - keep;
+
+	myInput.erase(myInput.begin(), myInput.begin() + drop);
+}
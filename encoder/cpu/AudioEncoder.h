@@ -0,0 +1,79 @@
+/*
+
+   Audio for MovieCart fields
+
+   The cart plays one 4 bit AUDV0 level per scanline, so each field takes
+   vsync + vblank + overscan + visible samples at the line rate. Audio of
+   any sample rate is pushed in as it arrives, resampled to the line rate
+   by a polyphase windowed sinc filter, then quantised to 16 levels with
+   the error fed back into the next samples, which moves the quantisation
+   noise up out of the range the ear is most sensitive to.
+
+   The line rate is the lines of a field times the fields a second of the
+   video, eg. 262 x 60 for NTSC, so each field's audio stays with its
+   picture whatever rate the console really plays them at.
+
+*/
+
+#ifndef __AUDIOENCODER__
+#define __AUDIOENCODER__
+
+#include <stdint.h>
+
+#include <vector>
+
+
+enum
+{
+	AudioShaping_None = 0,		// nearest level
+	AudioShaping_First,			// error diffused to the next sample
+	AudioShaping_Second,		// second order highpass noise
+};
+
+class AudioEncoder
+{
+public:
+	AudioEncoder();
+
+	// starts a new stream, input mono at inputRate
+	void				setup(double inputRate, int linesPerField, double fieldRate,
+							int shaping = AudioShaping_First);
+
+	// channels interleaved, mixed down to mono
+	void				push(const float *samples, int count, int channels = 1);
+
+	// input samples still wanted before encodeField() can fill a field
+	int					getInputNeeded() const;
+
+	// the next field's levels, false and dst untouched until there's enough input
+	bool				encodeField(uint8_t *dst);
+
+	// at the end of the input, fills what the next field still needs with silence
+	void				flush();
+
+	// throws away input more than maxFields ahead, for live sources
+	void				dropBacklog(int maxFields);
+
+	int					getLinesPerField() const { return myLines; }
+
+private:
+
+	void				makeTaps(double cutoff);
+
+	static const int	NumPhases = 256;
+
+	int					myLines;
+	int					myShaping;
+
+	int					myHalfTaps;			// either side of the output time
+	int					myNumTaps;			// 2 * myHalfTaps rounded up to 8
+	std::vector<float>	myTaps;				// myNumTaps per phase
+
+	uint64_t			myStep;				// input samples per output, 32.32
+	uint64_t			myPos;				// next output, 32.32 into myInput
+	std::vector<float>	myInput;			// unused input, history first
+
+	float				myError[2];			// last quantisation errors
+};
+
+#endif
@@ -0,0 +1,1033 @@
+/*
+
+   Inner loop kernels of the colorize engine
+
+*/
+
+#include "ColorKernels.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define COLORKERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(COLORKERNELS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET(x)	__attribute__((target(x)))
+#else
+#define TARGET(x)
+#endif
+
+
+const float	colorScales[3] = {0.299f, 0.587f, 0.114f};
+
+// colorScales in 16 bit fractions, adding up to exactly 1/8
+const uint16_t	colorScales16[3] = {2449, 4809, 934};
+
+// a pixel channel as an 8 bit level
+static inline int
+toLevel(float v)
+{
+	int		level = (int)(v * 255.0f + 0.5f);
+
+	return level < 0 ? 0 : level > 255 ? 255 : level;
+}
+
+
+static void
+nearestColorsScalar(const float* r, const float* g, const float* b, int numColors,
+					const float pal[3][256], const uint8_t* entries, int numEntries,
+					uint8_t* nearest)
+{
+	for (int i=0; i<numColors; i++)
+	{
+		float	color[3] = { r[i], g[i], b[i] };
+		float	bestDist = HUGE_VAL;
+		int		best = entries[0];
+
+		for (int j=0; j<numEntries; j++)
+		{
+			int		idx = entries[j];
+			float	entry[3] = { pal[0][idx], pal[1][idx], pal[2][idx] };
+			float	d = colorDist(color, entry);
+
+			if (d < bestDist)
+			{
+				bestDist = d;
+				best = idx;
+			}
+		}
+
+		nearest[i] = best;
+	}
+}
+
+static void
+scoreForegroundsScalar(const float* pixels, int numPixels, const float* backColor,
+					   const float pal[3][256], const int* candidates, int numCandidates,
+					   float bound, float* errors)
+{
+	for (int i=0; i<numCandidates; i++)
+	{
+		float	cellColor[3];
+		int		idx = candidates[i];
+
+		cellColor[0] = pal[0][idx];
+		cellColor[1] = pal[1][idx];
+		cellColor[2] = pal[2][idx];
+
+		float	cellError = 0;
+		const float* npixel = pixels;
+
+		for (int x=0; x<numPixels; x++, npixel += 4)
+		{
+			float distBack = colorDist(npixel, backColor);
+			float distWhite = colorDist(npixel, cellColor);
+
+			cellError += distBack < distWhite ? distBack : distWhite;
+			if (cellError >= bound)
+				break;
+		}
+
+		errors[i] = cellError;
+		if (cellError < bound)
+			bound = cellError;
+	}
+}
+
+static void
+paletteDistancesScalar(const float* pixels, int numPixels, const float pal[3][256],
+					   int numColors, float* dist)
+{
+	for (int x=0; x<numPixels; x++, pixels += 4, dist += numColors)
+	{
+		for (int i=0; i<numColors; i++)
+		{
+			float	entry[3] = { pal[0][i], pal[1][i], pal[2][i] };
+
+			dist[i] = colorDist(pixels, entry);
+		}
+	}
+}
+
+static void
+sumMinDistancesScalar(const float* dist, int numColors, int numPixels, int backIdx,
+					  float* errors)
+{
+	for (int i=0; i<numColors; i++)
+		errors[i] = 0;
+
+	for (int x=0; x<numPixels; x++, dist += numColors)
+	{
+		float	distBack = dist[backIdx];
+
+		for (int i=0; i<numColors; i++)
+			errors[i] += distBack < dist[i] ? distBack : dist[i];
+	}
+}
+
+// Each weighted square is rounded down on its own, as the mulhi of the
+// SIMD versions does, so the sum can't pass 8128, and 8 pixels of them
+// add up in 16 bits.
+
+static void
+paletteDistances16Scalar(const float* pixels, int numPixels, const int16_t pal[3][256],
+						 int numColors, uint16_t* dist)
+{
+	for (int x=0; x<numPixels; x++, pixels += 4, dist += numColors)
+	{
+		int		level[3] = { toLevel(pixels[0]), toLevel(pixels[1]), toLevel(pixels[2]) };
+
+		for (int i=0; i<numColors; i++)
+		{
+			uint32_t	d = 0;
+
+			for (int j=0; j<3; j++)
+			{
+				uint32_t	diff = (uint32_t)abs(level[j] - pal[j][i]);
+				d += (diff * diff * colorScales16[j]) >> 16;
+			}
+
+			dist[i] = (uint16_t)d;
+		}
+	}
+}
+
+static void
+sumMinDistances16Scalar(const uint16_t* dist, int numColors, int numPixels, int backIdx,
+						float* errors)
+{
+	uint32_t	sums[256];
+
+	for (int i=0; i<numColors; i++)
+		sums[i] = 0;
+
+	for (int x=0; x<numPixels; x++, dist += numColors)
+	{
+		uint16_t	distBack = dist[backIdx];
+
+		for (int i=0; i<numColors; i++)
+			sums[i] += distBack < dist[i] ? distBack : dist[i];
+	}
+
+	for (int i=0; i<numColors; i++)
+		errors[i] = (float)sums[i];
+}
+
+static void
+scaleAddRowScalar(float* acc, const float* src, int n, float weight)
+{
+	for (int i=0; i<n; i++)
+		acc[i] += src[i] * weight;
+}
+
+static void
+filterRowScalar(const float* src, int numOut, const int* first, const int* count,
+				const float* weights, float* dst)
+{
+	for (int i=0; i<numOut; i++, dst += 4)
+	{
+		const float*	pixel = &src[4 * first[i]];
+		float			sum[4] = { 0, 0, 0, 0 };
+
+		for (int j=0; j<count[i]; j++, pixel += 4)
+		{
+			float	w = *weights++;
+
+			for (int k=0; k<4; k++)
+				sum[k] += pixel[k] * w;
+		}
+
+		for (int k=0; k<4; k++)
+			dst[k] = sum[k];
+	}
+}
+
+// 8 running sums, folded like the SIMD versions
+
+static float
+dotProductScalar(const float* a, const float* b, int n)
+{
+	float	sum[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+	for (int i=0; i<n; i+=8)
+	{
+		for (int j=0; j<8; j++)
+			sum[j] += a[i+j] * b[i+j];
+	}
+
+	for (int j=0; j<4; j++)
+		sum[j] += sum[j+4];
+
+	return (sum[0] + sum[2]) + (sum[1] + sum[3]);
+}
+
+// weighted fore - back, and its length squared, the same for every kernel
+static inline float
+thresholdAxis(const float fore[4], const float back[4], float axis[4])
+{
+	for (int c=0; c<3; c++)
+		axis[c] = (fore[c] - back[c]) * colorScales[c];
+	axis[3] = 0.0f;
+
+	return ((fore[0] - back[0]) * axis[0] + (fore[1] - back[1]) * axis[1]) + (fore[2] - back[2]) * axis[2];
+}
+
+static void
+thresholdPixelsScalar(float* pixels, int numPixels, const float fore[4], const float back[4],
+					  const float* thresholds)
+{
+	float	axis[4];
+	float	length = thresholdAxis(fore, back, axis);
+
+	for (int i=0; i<numPixels; i++, pixels += 4)
+	{
+		float	along = ((pixels[0] - back[0]) * axis[0] + (pixels[1] - back[1]) * axis[1]) +
+						(pixels[2] - back[2]) * axis[2];
+
+		memcpy(pixels, along > thresholds[i] * length ? fore : back, 4 * sizeof(float));
+	}
+}
+
+#ifdef COLORKERNELS_X86
+
+// 4 candidates per pass
+
+TARGET("sse4.1") static void
+scoreForegroundsSSE41(const float* pixels, int numPixels, const float* backColor,
+					  const float pal[3][256], const int* candidates, int numCandidates,
+					  float bound, float* errors)
+{
+	const __m128	s0 = _mm_set1_ps(colorScales[0]);
+	const __m128	s1 = _mm_set1_ps(colorScales[1]);
+	const __m128	s2 = _mm_set1_ps(colorScales[2]);
+
+	for (int i=0; i<numCandidates; i+=4)
+	{
+		int		idx[4];
+
+		// pad the last pass with the last candidate
+		for (int j=0; j<4; j++)
+			idx[j] = candidates[i+j < numCandidates ? i+j : numCandidates-1];
+
+		__m128	cr = _mm_setr_ps(pal[0][idx[0]], pal[0][idx[1]], pal[0][idx[2]], pal[0][idx[3]]);
+		__m128	cg = _mm_setr_ps(pal[1][idx[0]], pal[1][idx[1]], pal[1][idx[2]], pal[1][idx[3]]);
+		__m128	cb = _mm_setr_ps(pal[2][idx[0]], pal[2][idx[1]], pal[2][idx[2]], pal[2][idx[3]]);
+
+		__m128	cellError = _mm_setzero_ps();
+		const float* npixel = pixels;
+
+		for (int x=0; x<numPixels; x++, npixel += 4)
+		{
+			__m128	distBack = _mm_set1_ps(colorDist(npixel, backColor));
+
+			__m128	dr = _mm_sub_ps(_mm_set1_ps(npixel[0]), cr);
+			__m128	dg = _mm_sub_ps(_mm_set1_ps(npixel[1]), cg);
+			__m128	db = _mm_sub_ps(_mm_set1_ps(npixel[2]), cb);
+
+			__m128	distWhite = _mm_add_ps(_mm_add_ps(
+									_mm_mul_ps(_mm_mul_ps(dr, dr), s0),
+									_mm_mul_ps(_mm_mul_ps(dg, dg), s1)),
+									_mm_mul_ps(_mm_mul_ps(db, db), s2));
+
+			cellError = _mm_add_ps(cellError, _mm_min_ps(distBack, distWhite));
+
+			// all lanes out
+			if (_mm_movemask_ps(_mm_cmplt_ps(cellError, _mm_set1_ps(bound))) == 0)
+				break;
+		}
+
+		float	out[4];
+		_mm_storeu_ps(out, cellError);
+
+		for (int j=0; j<4 && i+j<numCandidates; j++)
+		{
+			errors[i+j] = out[j];
+			if (out[j] < bound)
+				bound = out[j];
+		}
+	}
+}
+
+// 8 candidates per pass
+
+TARGET("avx2") static void
+scoreForegroundsAVX2(const float* pixels, int numPixels, const float* backColor,
+					 const float pal[3][256], const int* candidates, int numCandidates,
+					 float bound, float* errors)
+{
+	const __m256	s0 = _mm256_set1_ps(colorScales[0]);
+	const __m256	s1 = _mm256_set1_ps(colorScales[1]);
+	const __m256	s2 = _mm256_set1_ps(colorScales[2]);
+
+	for (int i=0; i<numCandidates; i+=8)
+	{
+		int		idx[8];
+
+		// pad the last pass with the last candidate
+		for (int j=0; j<8; j++)
+			idx[j] = candidates[i+j < numCandidates ? i+j : numCandidates-1];
+
+		__m256	cr = _mm256_setr_ps(pal[0][idx[0]], pal[0][idx[1]], pal[0][idx[2]], pal[0][idx[3]],
+									pal[0][idx[4]], pal[0][idx[5]], pal[0][idx[6]], pal[0][idx[7]]);
+		__m256	cg = _mm256_setr_ps(pal[1][idx[0]], pal[1][idx[1]], pal[1][idx[2]], pal[1][idx[3]],
+									pal[1][idx[4]], pal[1][idx[5]], pal[1][idx[6]], pal[1][idx[7]]);
+		__m256	cb = _mm256_setr_ps(pal[2][idx[0]], pal[2][idx[1]], pal[2][idx[2]], pal[2][idx[3]],
+									pal[2][idx[4]], pal[2][idx[5]], pal[2][idx[6]], pal[2][idx[7]]);
+
+		__m256	cellError = _mm256_setzero_ps();
+		const float* npixel = pixels;
+
+		for (int x=0; x<numPixels; x++, npixel += 4)
+		{
+			__m256	distBack = _mm256_set1_ps(colorDist(npixel, backColor));
+
+			__m256	dr = _mm256_sub_ps(_mm256_set1_ps(npixel[0]), cr);
+			__m256	dg = _mm256_sub_ps(_mm256_set1_ps(npixel[1]), cg);
+			__m256	db = _mm256_sub_ps(_mm256_set1_ps(npixel[2]), cb);
+
+			// no fma, to round the same as the scalar code
+			__m256	distWhite = _mm256_add_ps(_mm256_add_ps(
+									_mm256_mul_ps(_mm256_mul_ps(dr, dr), s0),
+									_mm256_mul_ps(_mm256_mul_ps(dg, dg), s1)),
+									_mm256_mul_ps(_mm256_mul_ps(db, db), s2));
+
+			cellError = _mm256_add_ps(cellError, _mm256_min_ps(distBack, distWhite));
+
+			// all lanes out
+			if (_mm256_movemask_ps(_mm256_cmp_ps(cellError, _mm256_set1_ps(bound), _CMP_LT_OQ)) == 0)
+				break;
+		}
+
+		float	out[8];
+		_mm256_storeu_ps(out, cellError);
+
+		for (int j=0; j<8 && i+j<numCandidates; j++)
+		{
+			errors[i+j] = out[j];
+			if (out[j] < bound)
+				bound = out[j];
+		}
+	}
+
+	_mm256_zeroupper();
+}
+
+// 4 colours per pass
+
+TARGET("sse4.1") static void
+nearestColorsSSE41(const float* r, const float* g, const float* b, int numColors,
+				   const float pal[3][256], const uint8_t* entries, int numEntries,
+				   uint8_t* nearest)
+{
+	const __m128	s0 = _mm_set1_ps(colorScales[0]);
+	const __m128	s1 = _mm_set1_ps(colorScales[1]);
+	const __m128	s2 = _mm_set1_ps(colorScales[2]);
+
+	int		i = 0;
+
+	for (; i+4<=numColors; i+=4)
+	{
+		__m128	cr = _mm_loadu_ps(&r[i]);
+		__m128	cg = _mm_loadu_ps(&g[i]);
+		__m128	cb = _mm_loadu_ps(&b[i]);
+
+		__m128	bestDist = _mm_set1_ps(HUGE_VAL);
+		__m128i	best = _mm_set1_epi32(entries[0]);
+
+		for (int j=0; j<numEntries; j++)
+		{
+			int		idx = entries[j];
+
+			__m128	dr = _mm_sub_ps(cr, _mm_set1_ps(pal[0][idx]));
+			__m128	dg = _mm_sub_ps(cg, _mm_set1_ps(pal[1][idx]));
+			__m128	db = _mm_sub_ps(cb, _mm_set1_ps(pal[2][idx]));
+
+			__m128	d = _mm_add_ps(_mm_add_ps(
+							_mm_mul_ps(_mm_mul_ps(dr, dr), s0),
+							_mm_mul_ps(_mm_mul_ps(dg, dg), s1)),
+							_mm_mul_ps(_mm_mul_ps(db, db), s2));
+
+			__m128	closer = _mm_cmplt_ps(d, bestDist);
+
+			bestDist = _mm_blendv_ps(bestDist, d, closer);
+			best = _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(best),
+						_mm_castsi128_ps(_mm_set1_epi32(idx)), closer));
+		}
+
+		int		out[4];
+		_mm_storeu_si128((__m128i*)out, best);
+
+		for (int k=0; k<4; k++)
+			nearest[i+k] = out[k];
+	}
+
+	if (i < numColors)
+		nearestColorsScalar(&r[i], &g[i], &b[i], numColors - i, pal, entries, numEntries, &nearest[i]);
+}
+
+// 8 colours per pass
+
+TARGET("avx2") static void
+nearestColorsAVX2(const float* r, const float* g, const float* b, int numColors,
+				  const float pal[3][256], const uint8_t* entries, int numEntries,
+				  uint8_t* nearest)
+{
+	const __m256	s0 = _mm256_set1_ps(colorScales[0]);
+	const __m256	s1 = _mm256_set1_ps(colorScales[1]);
+	const __m256	s2 = _mm256_set1_ps(colorScales[2]);
+
+	int		i = 0;
+
+	for (; i+8<=numColors; i+=8)
+	{
+		__m256	cr = _mm256_loadu_ps(&r[i]);
+		__m256	cg = _mm256_loadu_ps(&g[i]);
+		__m256	cb = _mm256_loadu_ps(&b[i]);
+
+		__m256	bestDist = _mm256_set1_ps(HUGE_VAL);
+		__m256i	best = _mm256_set1_epi32(entries[0]);
+
+		for (int j=0; j<numEntries; j++)
+		{
+			int		idx = entries[j];
+
+			__m256	dr = _mm256_sub_ps(cr, _mm256_set1_ps(pal[0][idx]));
+			__m256	dg = _mm256_sub_ps(cg, _mm256_set1_ps(pal[1][idx]));
+			__m256	db = _mm256_sub_ps(cb, _mm256_set1_ps(pal[2][idx]));
+
+			// no fma, to round the same as the scalar code
+			__m256	d = _mm256_add_ps(_mm256_add_ps(
+							_mm256_mul_ps(_mm256_mul_ps(dr, dr), s0),
+							_mm256_mul_ps(_mm256_mul_ps(dg, dg), s1)),
+							_mm256_mul_ps(_mm256_mul_ps(db, db), s2));
+
+			__m256	closer = _mm256_cmp_ps(d, bestDist, _CMP_LT_OQ);
+
+			bestDist = _mm256_blendv_ps(bestDist, d, closer);
+			best = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(best),
+						_mm256_castsi256_ps(_mm256_set1_epi32(idx)), closer));
+		}
+
+		int		out[8];
+		_mm256_storeu_si256((__m256i*)out, best);
+
+		for (int k=0; k<8; k++)
+			nearest[i+k] = out[k];
+	}
+
+	_mm256_zeroupper();
+
+	if (i < numColors)
+		nearestColorsScalar(&r[i], &g[i], &b[i], numColors - i, pal, entries, numEntries, &nearest[i]);
+}
+
+// 4 entries per pass
+
+TARGET("sse4.1") static void
+paletteDistancesSSE41(const float* pixels, int numPixels, const float pal[3][256],
+					  int numColors, float* dist)
+{
+	const __m128	s0 = _mm_set1_ps(colorScales[0]);
+	const __m128	s1 = _mm_set1_ps(colorScales[1]);
+	const __m128	s2 = _mm_set1_ps(colorScales[2]);
+
+	for (int x=0; x<numPixels; x++, pixels += 4, dist += numColors)
+	{
+		__m128	pr = _mm_set1_ps(pixels[0]);
+		__m128	pg = _mm_set1_ps(pixels[1]);
+		__m128	pb = _mm_set1_ps(pixels[2]);
+
+		for (int i=0; i<numColors; i+=4)
+		{
+			__m128	dr = _mm_sub_ps(pr, _mm_loadu_ps(&pal[0][i]));
+			__m128	dg = _mm_sub_ps(pg, _mm_loadu_ps(&pal[1][i]));
+			__m128	db = _mm_sub_ps(pb, _mm_loadu_ps(&pal[2][i]));
+
+			_mm_storeu_ps(&dist[i], _mm_add_ps(_mm_add_ps(
+									_mm_mul_ps(_mm_mul_ps(dr, dr), s0),
+									_mm_mul_ps(_mm_mul_ps(dg, dg), s1)),
+									_mm_mul_ps(_mm_mul_ps(db, db), s2)));
+		}
+	}
+}
+
+TARGET("sse4.1") static void
+sumMinDistancesSSE41(const float* dist, int numColors, int numPixels, int backIdx,
+					 float* errors)
+{
+	for (int i=0; i<numColors; i+=4)
+	{
+		__m128	cellError = _mm_setzero_ps();
+		const float* row = dist;
+
+		for (int x=0; x<numPixels; x++, row += numColors)
+		{
+			__m128	distBack = _mm_set1_ps(row[backIdx]);
+
+			cellError = _mm_add_ps(cellError, _mm_min_ps(distBack, _mm_loadu_ps(&row[i])));
+		}
+
+		_mm_storeu_ps(&errors[i], cellError);
+	}
+}
+
+// 8 fixed point entries per pass
+
+TARGET("sse4.1") static void
+paletteDistances16SSE41(const float* pixels, int numPixels, const int16_t pal[3][256],
+						int numColors, uint16_t* dist)
+{
+	const __m128i	s0 = _mm_set1_epi16((short)colorScales16[0]);
+	const __m128i	s1 = _mm_set1_epi16((short)colorScales16[1]);
+	const __m128i	s2 = _mm_set1_epi16((short)colorScales16[2]);
+
+	for (int x=0; x<numPixels; x++, pixels += 4, dist += numColors)
+	{
+		__m128i	pr = _mm_set1_epi16((short)toLevel(pixels[0]));
+		__m128i	pg = _mm_set1_epi16((short)toLevel(pixels[1]));
+		__m128i	pb = _mm_set1_epi16((short)toLevel(pixels[2]));
+
+		for (int i=0; i<numColors; i+=8)
+		{
+			__m128i	dr = _mm_sub_epi16(pr, _mm_loadu_si128((const __m128i*)&pal[0][i]));
+			__m128i	dg = _mm_sub_epi16(pg, _mm_loadu_si128((const __m128i*)&pal[1][i]));
+			__m128i	db = _mm_sub_epi16(pb, _mm_loadu_si128((const __m128i*)&pal[2][i]));
+
+			// the squares fit unsigned 16 bits
+			_mm_storeu_si128((__m128i*)&dist[i], _mm_add_epi16(_mm_add_epi16(
+									_mm_mulhi_epu16(_mm_mullo_epi16(dr, dr), s0),
+									_mm_mulhi_epu16(_mm_mullo_epi16(dg, dg), s1)),
+									_mm_mulhi_epu16(_mm_mullo_epi16(db, db), s2)));
+		}
+	}
+}
+
+TARGET("sse4.1") static void
+sumMinDistances16SSE41(const uint16_t* dist, int numColors, int numPixels, int backIdx,
+					   float* errors)
+{
+	for (int i=0; i<numColors; i+=8)
+	{
+		__m128i	lo = _mm_setzero_si128();
+		__m128i	hi = _mm_setzero_si128();
+		const uint16_t* row = dist;
+
+		for (int x=0; x<numPixels; )
+		{
+			__m128i	sum = _mm_setzero_si128();
+
+			for (int end = x + 8 < numPixels ? x + 8 : numPixels; x<end; x++, row += numColors)
+			{
+				__m128i	distBack = _mm_set1_epi16((short)row[backIdx]);
+				sum = _mm_add_epi16(sum, _mm_min_epu16(distBack, _mm_loadu_si128((const __m128i*)&row[i])));
+			}
+
+			lo = _mm_add_epi32(lo, _mm_cvtepu16_epi32(sum));
+			hi = _mm_add_epi32(hi, _mm_cvtepu16_epi32(_mm_srli_si128(sum, 8)));
+		}
+
+		_mm_storeu_ps(&errors[i], _mm_cvtepi32_ps(lo));
+		_mm_storeu_ps(&errors[i+4], _mm_cvtepi32_ps(hi));
+	}
+}
+
+TARGET("sse4.1") static void
+scaleAddRowSSE41(float* acc, const float* src, int n, float weight)
+{
+	__m128	w = _mm_set1_ps(weight);
+	int		i = 0;
+
+	for (; i+4<=n; i+=4)
+		_mm_storeu_ps(&acc[i], _mm_add_ps(_mm_loadu_ps(&acc[i]), _mm_mul_ps(_mm_loadu_ps(&src[i]), w)));
+
+	for (; i<n; i++)
+		acc[i] += src[i] * weight;
+}
+
+// a pixel per vector, AVX2 has no wider version to offer
+
+TARGET("sse4.1") static void
+filterRowSSE41(const float* src, int numOut, const int* first, const int* count,
+			   const float* weights, float* dst)
+{
+	for (int i=0; i<numOut; i++, dst += 4)
+	{
+		const float*	pixel = &src[4 * first[i]];
+		__m128			sum = _mm_setzero_ps();
+
+		for (int j=0; j<count[i]; j++, pixel += 4)
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(pixel), _mm_set1_ps(*weights++)));
+
+		_mm_storeu_ps(dst, sum);
+	}
+}
+
+#define filterRowAVX2	filterRowSSE41
+
+TARGET("sse4.1") static float
+dotProductSSE41(const float* a, const float* b, int n)
+{
+	__m128	lo = _mm_setzero_ps();
+	__m128	hi = _mm_setzero_ps();
+
+	for (int i=0; i<n; i+=8)
+	{
+		lo = _mm_add_ps(lo, _mm_mul_ps(_mm_loadu_ps(&a[i]), _mm_loadu_ps(&b[i])));
+		hi = _mm_add_ps(hi, _mm_mul_ps(_mm_loadu_ps(&a[i+4]), _mm_loadu_ps(&b[i+4])));
+	}
+
+	__m128	sum = _mm_add_ps(lo, hi);
+
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+
+	return _mm_cvtss_f32(sum);
+}
+
+// a pixel per vector
+
+TARGET("sse4.1") static void
+thresholdPixelsSSE41(float* pixels, int numPixels, const float fore[4], const float back[4],
+					 const float* thresholds)
+{
+	float	axis[4];
+	float	length = thresholdAxis(fore, back, axis);
+
+	__m128	f = _mm_loadu_ps(fore);
+	__m128	b = _mm_loadu_ps(back);
+	__m128	a = _mm_loadu_ps(axis);
+	__m128	len = _mm_set1_ps(length);
+
+	for (int i=0; i<numPixels; i++, pixels += 4)
+	{
+		__m128	m = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(pixels), b), a);
+		__m128	along = _mm_add_ss(_mm_add_ss(m, _mm_shuffle_ps(m, m, 1)), _mm_shuffle_ps(m, m, 2));
+
+		along = _mm_shuffle_ps(along, along, 0);
+		__m128	isFore = _mm_cmpgt_ps(along, _mm_mul_ps(_mm_set1_ps(thresholds[i]), len));
+
+		_mm_storeu_ps(pixels, _mm_blendv_ps(b, f, isFore));
+	}
+}
+
+// 8 entries per pass
+
+TARGET("avx2") static void
+paletteDistancesAVX2(const float* pixels, int numPixels, const float pal[3][256],
+					 int numColors, float* dist)
+{
+	const __m256	s0 = _mm256_set1_ps(colorScales[0]);
+	const __m256	s1 = _mm256_set1_ps(colorScales[1]);
+	const __m256	s2 = _mm256_set1_ps(colorScales[2]);
+
+	for (int x=0; x<numPixels; x++, pixels += 4, dist += numColors)
+	{
+		__m256	pr = _mm256_set1_ps(pixels[0]);
+		__m256	pg = _mm256_set1_ps(pixels[1]);
+		__m256	pb = _mm256_set1_ps(pixels[2]);
+
+		for (int i=0; i<numColors; i+=8)
+		{
+			__m256	dr = _mm256_sub_ps(pr, _mm256_loadu_ps(&pal[0][i]));
+			__m256	dg = _mm256_sub_ps(pg, _mm256_loadu_ps(&pal[1][i]));
+			__m256	db = _mm256_sub_ps(pb, _mm256_loadu_ps(&pal[2][i]));
+
+			// no fma, to round the same as the scalar code
+			_mm256_storeu_ps(&dist[i], _mm256_add_ps(_mm256_add_ps(
+									_mm256_mul_ps(_mm256_mul_ps(dr, dr), s0),
+									_mm256_mul_ps(_mm256_mul_ps(dg, dg), s1)),
+									_mm256_mul_ps(_mm256_mul_ps(db, db), s2)));
+		}
+	}
+
+	_mm256_zeroupper();
+}
+
+TARGET("avx2") static void
+sumMinDistancesAVX2(const float* dist, int numColors, int numPixels, int backIdx,
+					float* errors)
+{
+	int		i = 0;
+
+	// 4 independent sums at a time to hide the add latency
+	for (; i+32<=numColors; i+=32)
+	{
+		__m256	e0 = _mm256_setzero_ps();
+		__m256	e1 = _mm256_setzero_ps();
+		__m256	e2 = _mm256_setzero_ps();
+		__m256	e3 = _mm256_setzero_ps();
+		const float* row = dist;
+
+		for (int x=0; x<numPixels; x++, row += numColors)
+		{
+			__m256	distBack = _mm256_set1_ps(row[backIdx]);
+
+			e0 = _mm256_add_ps(e0, _mm256_min_ps(distBack, _mm256_loadu_ps(&row[i])));
+			e1 = _mm256_add_ps(e1, _mm256_min_ps(distBack, _mm256_loadu_ps(&row[i+8])));
+			e2 = _mm256_add_ps(e2, _mm256_min_ps(distBack, _mm256_loadu_ps(&row[i+16])));
+			e3 = _mm256_add_ps(e3, _mm256_min_ps(distBack, _mm256_loadu_ps(&row[i+24])));
+		}
+
+		_mm256_storeu_ps(&errors[i], e0);
+		_mm256_storeu_ps(&errors[i+8], e1);
+		_mm256_storeu_ps(&errors[i+16], e2);
+		_mm256_storeu_ps(&errors[i+24], e3);
+	}
+
+	for (; i<numColors; i+=8)
+	{
+		__m256	cellError = _mm256_setzero_ps();
+		const float* row = dist;
+
+		for (int x=0; x<numPixels; x++, row += numColors)
+		{
+			__m256	distBack = _mm256_set1_ps(row[backIdx]);
+
+			cellError = _mm256_add_ps(cellError, _mm256_min_ps(distBack, _mm256_loadu_ps(&row[i])));
+		}
+
+		_mm256_storeu_ps(&errors[i], cellError);
+	}
+
+	_mm256_zeroupper();
+}
+
+// 16 fixed point entries per pass
+
+TARGET("avx2") static void
+paletteDistances16AVX2(const float* pixels, int numPixels, const int16_t pal[3][256],
+					   int numColors, uint16_t* dist)
+{
+	const __m256i	s0 = _mm256_set1_epi16((short)colorScales16[0]);
+	const __m256i	s1 = _mm256_set1_epi16((short)colorScales16[1]);
+	const __m256i	s2 = _mm256_set1_epi16((short)colorScales16[2]);
+
+	for (int x=0; x<numPixels; x++, pixels += 4, dist += numColors)
+	{
+		__m256i	pr = _mm256_set1_epi16((short)toLevel(pixels[0]));
+		__m256i	pg = _mm256_set1_epi16((short)toLevel(pixels[1]));
+		__m256i	pb = _mm256_set1_epi16((short)toLevel(pixels[2]));
+
+		for (int i=0; i<numColors; i+=16)
+		{
+			__m256i	dr = _mm256_sub_epi16(pr, _mm256_loadu_si256((const __m256i*)&pal[0][i]));
+			__m256i	dg = _mm256_sub_epi16(pg, _mm256_loadu_si256((const __m256i*)&pal[1][i]));
+			__m256i	db = _mm256_sub_epi16(pb, _mm256_loadu_si256((const __m256i*)&pal[2][i]));
+
+			_mm256_storeu_si256((__m256i*)&dist[i], _mm256_add_epi16(_mm256_add_epi16(
+									_mm256_mulhi_epu16(_mm256_mullo_epi16(dr, dr), s0),
+									_mm256_mulhi_epu16(_mm256_mullo_epi16(dg, dg), s1)),
+									_mm256_mulhi_epu16(_mm256_mullo_epi16(db, db), s2)));
+		}
+	}
+
+	_mm256_zeroupper();
+}
+
+TARGET("avx2") static void
+sumMinDistances16AVX2(const uint16_t* dist, int numColors, int numPixels, int backIdx,
+					  float* errors)
+{
+	int		i = 0;
+
+	// 4 independent sums at a time, widened to 32 bits every 8 pixels
+	for (; i+64<=numColors; i+=64)
+	{
+		__m256i	acc[8];
+		for (int j=0; j<8; j++)
+			acc[j] = _mm256_setzero_si256();
+
+		const uint16_t* row = dist;
+
+		for (int x=0; x<numPixels; )
+		{
+			__m256i	e0 = _mm256_setzero_si256();
+			__m256i	e1 = _mm256_setzero_si256();
+			__m256i	e2 = _mm256_setzero_si256();
+			__m256i	e3 = _mm256_setzero_si256();
+
+			for (int end = x + 8 < numPixels ? x + 8 : numPixels; x<end; x++, row += numColors)
+			{
+				__m256i	distBack = _mm256_set1_epi16((short)row[backIdx]);
+
+				e0 = _mm256_add_epi16(e0, _mm256_min_epu16(distBack, _mm256_loadu_si256((const __m256i*)&row[i])));
+				e1 = _mm256_add_epi16(e1, _mm256_min_epu16(distBack, _mm256_loadu_si256((const __m256i*)&row[i+16])));
+				e2 = _mm256_add_epi16(e2, _mm256_min_epu16(distBack, _mm256_loadu_si256((const __m256i*)&row[i+32])));
+				e3 = _mm256_add_epi16(e3, _mm256_min_epu16(distBack, _mm256_loadu_si256((const __m256i*)&row[i+48])));
+			}
+
+			__m256i	e[4] = { e0, e1, e2, e3 };
+
+			for (int j=0; j<4; j++)
+			{
+				acc[2*j] = _mm256_add_epi32(acc[2*j], _mm256_cvtepu16_epi32(_mm256_castsi256_si128(e[j])));
+				acc[2*j+1] = _mm256_add_epi32(acc[2*j+1], _mm256_cvtepu16_epi32(_mm256_extracti128_si256(e[j], 1)));
+			}
+		}
+
+		for (int j=0; j<8; j++)
+			_mm256_storeu_ps(&errors[i + 8*j], _mm256_cvtepi32_ps(acc[j]));
+	}
+
+	for (; i<numColors; i+=16)
+	{
+		__m256i	lo = _mm256_setzero_si256();
+		__m256i	hi = _mm256_setzero_si256();
+		const uint16_t* row = dist;
+
+		for (int x=0; x<numPixels; )
+		{
+			__m256i	sum = _mm256_setzero_si256();
+
+			for (int end = x + 8 < numPixels ? x + 8 : numPixels; x<end; x++, row += numColors)
+			{
+				__m256i	distBack = _mm256_set1_epi16((short)row[backIdx]);
+				sum = _mm256_add_epi16(sum, _mm256_min_epu16(distBack,
+									   _mm256_loadu_si256((const __m256i*)&row[i])));
+			}
+
+			lo = _mm256_add_epi32(lo, _mm256_cvtepu16_epi32(_mm256_castsi256_si128(sum)));
+			hi = _mm256_add_epi32(hi, _mm256_cvtepu16_epi32(_mm256_extracti128_si256(sum, 1)));
+		}
+
+		_mm256_storeu_ps(&errors[i], _mm256_cvtepi32_ps(lo));
+		_mm256_storeu_ps(&errors[i+8], _mm256_cvtepi32_ps(hi));
+	}
+
+	_mm256_zeroupper();
+}
+
+TARGET("avx2") static void
+scaleAddRowAVX2(float* acc, const float* src, int n, float weight)
+{
+	__m256	w = _mm256_set1_ps(weight);
+	int		i = 0;
+
+	for (; i+8<=n; i+=8)
+	{
+		_mm256_storeu_ps(&acc[i], _mm256_add_ps(_mm256_loadu_ps(&acc[i]),
+												_mm256_mul_ps(_mm256_loadu_ps(&src[i]), w)));
+	}
+
+	for (; i<n; i++)
+		acc[i] += src[i] * weight;
+
+	_mm256_zeroupper();
+}
+
+TARGET("avx2") static float
+dotProductAVX2(const float* a, const float* b, int n)
+{
+	__m256	acc = _mm256_setzero_ps();
+
+	for (int i=0; i<n; i+=8)
+		acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(&a[i]), _mm256_loadu_ps(&b[i])));
+
+	__m128	sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+
+	_mm256_zeroupper();
+	return _mm_cvtss_f32(sum);
+}
+
+// two pixels per vector, one in each half
+
+TARGET("avx2") static void
+thresholdPixelsAVX2(float* pixels, int numPixels, const float fore[4], const float back[4],
+					const float* thresholds)
+{
+	float	axis[4];
+	float	length = thresholdAxis(fore, back, axis);
+
+	__m256	f = _mm256_broadcast_ps((const __m128*)fore);
+	__m256	b = _mm256_broadcast_ps((const __m128*)back);
+	__m256	a = _mm256_broadcast_ps((const __m128*)axis);
+	__m256	len = _mm256_set1_ps(length);
+	int		i = 0;
+
+	for (; i+2<=numPixels; i+=2, pixels += 8)
+	{
+		__m256	m = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(pixels), b), a);
+		__m256	along = _mm256_add_ps(_mm256_add_ps(m, _mm256_permute_ps(m, 1)), _mm256_permute_ps(m, 2));
+
+		along = _mm256_permute_ps(along, 0);
+		__m256	threshold = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(thresholds[i])),
+												 _mm_set1_ps(thresholds[i+1]), 1);
+		__m256	isFore = _mm256_cmp_ps(along, _mm256_mul_ps(threshold, len), _CMP_GT_OQ);
+
+		_mm256_storeu_ps(pixels, _mm256_blendv_ps(b, f, isFore));
+	}
+
+	_mm256_zeroupper();
+
+	if (i < numPixels)
+		thresholdPixelsSSE41(pixels, numPixels - i, fore, back, &thresholds[i]);
+}
+
+enum
+{
+	CPU_SSE41 = 1,
+	CPU_AVX2 = 2
+};
+
+static int
+detectCPU()
+{
+#ifdef _MSC_VER
+	int		info[4];
+	int		features = 0;
+
+	__cpuid(info, 0);
+	int		maxLeaf = info[0];
+
+	__cpuid(info, 1);
+	if (info[2] & (1 << 19))
+		features |= CPU_SSE41;
+
+	// avx2 also needs the OS to save the ymm registers
+	bool	osAVX = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) &&
+					((_xgetbv(0) & 6) == 6);
+
+	if (osAVX && maxLeaf >= 7)
+	{
+		__cpuidex(info, 7, 0);
+		if (info[1] & (1 << 5))
+			features |= CPU_AVX2;
+	}
+
+	return features;
+#else
+	int		features = 0;
+
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.1"))
+		features |= CPU_SSE41;
+	if (__builtin_cpu_supports("avx2"))
+		features |= CPU_AVX2;
+
+	return features;
+#endif
+}
+
+#endif // COLORKERNELS_X86
+
+
+static const char*		kernelName = "scalar";
+
+static int
+selectFeatures()
+{
+#ifdef COLORKERNELS_X86
+	int		features = detectCPU();
+
+	// COLORIZE_KERNEL=scalar or sse4.1 caps the kernels, to compare them
+	const char*	limit = getenv("COLORIZE_KERNEL");
+	if (limit && !strcmp(limit, "scalar"))
+		features = 0;
+	else if (limit && !strcmp(limit, "sse4.1"))
+		features &= CPU_SSE41;
+
+	if (features & CPU_AVX2)
+		kernelName = "avx2";
+	else if (features & CPU_SSE41)
+		kernelName = "sse4.1";
+
+	return features;
+#else
+	return 0;
+#endif
+}
+
+static const int	cpuFeatures = selectFeatures();
+
+#ifdef COLORKERNELS_X86
+#define SELECT(name)	((cpuFeatures & CPU_AVX2) ? name##AVX2 : (cpuFeatures & CPU_SSE41) ? name##SSE41 : name##Scalar)
+#else
+#define SELECT(name)	name##Scalar
+#endif
+
+ScoreForegroundsFunc	scoreForegrounds = SELECT(scoreForegrounds);
+NearestColorsFunc		nearestColors = SELECT(nearestColors);
+PaletteDistancesFunc	paletteDistances = SELECT(paletteDistances);
+SumMinDistancesFunc		sumMinDistances = SELECT(sumMinDistances);
+PaletteDistances16Func	paletteDistances16 = SELECT(paletteDistances16);
+SumMinDistances16Func	sumMinDistances16 = SELECT(sumMinDistances16);
+ScaleAddRowFunc			scaleAddRow = SELECT(scaleAddRow);
+FilterRowFunc			filterRow = SELECT(filterRow);
+DotProductFunc			dotProduct = SELECT(dotProduct);
+ThresholdPixelsFunc		thresholdPixels = SELECT(thresholdPixels);
+
+const char*
+getColorKernelName()
+{
+	return kernelName;
+}
@@ -0,0 +1,116 @@
+/*
+
+   Inner loop kernels of the colorize engine
+
+   Each kernel has a scalar version and, on x86, SSE4.1 and AVX2 versions
+   picked at runtime by CPU. All versions add up the same float terms in
+   the same order, so they give bit identical results. The 16 bit fixed
+   point kernels are exact integer sums, and so identical too.
+
+*/
+
+#ifndef __COLORKERNELS__
+#define __COLORKERNELS__
+
+#include <stdint.h>
+
+// weights of the r, g, b differences in colour distances
+extern const float	colorScales[3];
+
+inline float
+colorDist(const float a[3], const float b[3])
+{
+	float dist =
+		(a[0] - b[0])*(a[0] - b[0]) * colorScales[0] +
+		(a[1] - b[1])*(a[1] - b[1]) * colorScales[1] +
+		(a[2] - b[2])*(a[2] - b[2]) * colorScales[2];
+
+	return dist;
+}
+
+// Error of each foreground candidate over one cell: the sum over the
+// pixels (rgba, 4 floats apart) of the distance to the nearer of the
+// candidate and the background colour. pal holds the palette as separate
+// r, g, b planes of 256 entries.
+// A candidate stops adding up once it reaches bound, or the lowest error
+// of the candidates before it, so it can't be the first best one.
+typedef void (*ScoreForegroundsFunc)(const float* pixels, int numPixels, const float* backColor,
+									 const float pal[3][256], const int* candidates, int numCandidates,
+									 float bound, float* errors);
+
+extern ScoreForegroundsFunc		scoreForegrounds;
+
+// Nearest of the listed palette entries to each colour, given as r, g, b
+// planes of numColors. Entries are tried in list order and the first of
+// equally near ones wins, so a list in palette order gives the lowest index.
+typedef void (*NearestColorsFunc)(const float* r, const float* g, const float* b, int numColors,
+								  const float pal[3][256], const uint8_t* entries, int numEntries,
+								  uint8_t* nearest);
+
+extern NearestColorsFunc		nearestColors;
+
+// Distance of each pixel (rgba, 4 floats apart) to each palette entry,
+// one row of numColors per pixel. numColors is a multiple of 8, the
+// entries past the palette hold whatever the planes are padded with.
+typedef void (*PaletteDistancesFunc)(const float* pixels, int numPixels, const float pal[3][256],
+									 int numColors, float* dist);
+
+extern PaletteDistancesFunc		paletteDistances;
+
+// Cell error of every foreground from the rows of paletteDistances: the
+// sum over the pixels of the distance to the nearer of the entry and the
+// background, as scoreForegrounds adds it up. numColors is a multiple of 8.
+typedef void (*SumMinDistancesFunc)(const float* dist, int numColors, int numPixels, int backIdx,
+									float* errors);
+
+extern SumMinDistancesFunc		sumMinDistances;
+
+// Fixed point versions of the two above, for twice the entries per
+// instruction and half the memory. Pixels are rounded to 8 bits a channel
+// and pal holds the palette as planes of 8 bit levels. A distance of 1.0
+// is 8128 (255 squared / 8), with the weights in colorScales16, so cells
+// of 8 pixels add up in 16 bits. The cell errors are exact sums, as
+// floats. numColors is a multiple of 16.
+extern const uint16_t	colorScales16[3];
+
+typedef void (*PaletteDistances16Func)(const float* pixels, int numPixels, const int16_t pal[3][256],
+									   int numColors, uint16_t* dist);
+
+extern PaletteDistances16Func	paletteDistances16;
+
+typedef void (*SumMinDistances16Func)(const uint16_t* dist, int numColors, int numPixels, int backIdx,
+									  float* errors);
+
+extern SumMinDistances16Func	sumMinDistances16;
+
+// acc[i] += src[i] * weight for n floats, a row of the area downsampler
+typedef void (*ScaleAddRowFunc)(float* acc, const float* src, int n, float weight);
+
+extern ScaleAddRowFunc			scaleAddRow;
+
+// Area filter along a row of rgba pixels: output i is the sum of count[i]
+// pixels from first[i] on, each times the next of weights.
+typedef void (*FilterRowFunc)(const float* src, int numOut, const int* first, const int* count,
+							  const float* weights, float* dst);
+
+extern FilterRowFunc			filterRow;
+
+// Sum of a[i] * b[i], n a multiple of 8, a tap of the audio resampler. Every
+// kernel adds in the same order, so the result doesn't depend on which runs.
+typedef float (*DotProductFunc)(const float* a, const float* b, int n);
+
+extern DotProductFunc			dotProduct;
+
+// Two colour threshold dither of numPixels rgba pixels: each becomes fore
+// when it lies further than its threshold along the way from back to fore,
+// measured with the colorScales weights, and back otherwise. fore and back
+// are written whole, the palette index in [3] included.
+typedef void (*ThresholdPixelsFunc)(float* pixels, int numPixels, const float fore[4],
+									const float back[4], const float* thresholds);
+
+extern ThresholdPixelsFunc		thresholdPixels;
+
+// "avx2", "sse4.1" or "scalar"
+const char*		getColorKernelName();
+
+#endif
@@ -0,0 +1,948 @@
+/*
+
+   Encoder benchmarks
+
+   Two layers, written out as one JSON document:
+
+	micro		time per call of each inner loop kernel, the palette
+				lookup, ditherLine, storeResults and a field of audio
+	fields		end to end fields/sec of the encoder over frame corpora,
+				for every combination of the listed colour search levels,
+				matrices, palettes, dither settings and thread counts
+
+   A corpus is an .mvc file, whose fields are decoded back into pictures,
+   or raw rgb24 frames given as file:WxH, eg. for examples/street.mp4
+
+	ffmpeg -i street.mp4 -vf scale=80:192 -f rawvideo -pix_fmt rgb24 street.rgb
+	colorize_bench ../../examples/street.mvc ../../examples/lion.mvc street.rgb:80x192
+
+   With no corpus a synthetic one is generated, so runs are comparable
+   between machines without any files.
+
+*/
+
+#include "AudioEncoder.h"
+#include "Colorizer.h"
+#include "ColorKernels.h"
+#include "PaletteLookup.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+// frames bottom row first, as Colorizer::execute takes them
+struct Corpus
+{
+	std::string					name;
+	int							width;
+	int							height;
+	int							palette;
+	std::vector<std::vector<float>>	frames;
+};
+
+struct MicroResult
+{
+	const char*		name;
+	const char*		unit;
+	double			ns;
+	long long		iterations;
+};
+
+struct FieldsResult
+{
+	const Corpus*	corpus;
+	int				palette;
+	int				matrix;
+	int				colorSearch;
+	bool			dither;
+	int				threads;
+	int				precision;
+	int				frames;
+	double			fieldsPerSec;
+	double			psnr;			// of the shown picture against the source, in dB
+};
+
+static const char* const	gPaletteNames[] =
+{
+	// same order as the Palette_ enum
+	"ntsc", "bw2", "bw4", "rgb", "randomterrain", "rubik", "pal", "secam", "colecovision"
+};
+
+static const char* const	gMatrixNames[] = { "floydsteinberg", "jin", "atkinson", "bayer", "bluenoise" };
+static const char* const	gPrecisionNames[] = { "float", "fixed16" };
+
+static const int	gNumPalettes = sizeof(gPaletteNames) / sizeof(gPaletteNames[0]);
+static const int	gNumMatrices = sizeof(gMatrixNames) / sizeof(gMatrixNames[0]);
+static const int	gNumPrecisions = sizeof(gPrecisionNames) / sizeof(gPrecisionNames[0]);
+
+static double		gMinSeconds = 0.25;
+static volatile float	gSink;
+
+
+static void
+usage()
+{
+	fprintf(stderr,
+		"usage: colorize_bench [options] [corpus ...]\n"
+		"\n"
+		"  corpus          file.mvc, or raw rgb24 frames as file:WxH\n"
+		"\n"
+		"  -o file         JSON results (stdout)\n"
+		"  -x layer        micro, fields or all (all)\n"
+		"  -n frames       frames per corpus and fields run (16)\n"
+		"  -S levels       colour search levels (0,1,2,3,4)\n"
+		"  -m matrices     floydsteinberg,jin,atkinson,bayer,bluenoise\n"
+		"                  (the error diffusion ones)\n"
+		"  -p palettes     ntsc,pal,... or corpus (all)\n"
+		"  -d dither       0,1 (1)\n"
+		"  -t threads      thread counts, 0 for all cores (1,0)\n"
+		"  -P precisions   float,fixed16 matrix search distances (float)\n"
+		"  -T seconds      least time per microbenchmark (0.25)\n");
+	exit(1);
+}
+
+static int
+lookupName(const char* name, const char* const names[], int numNames)
+{
+	for (int i=0; i<numNames; i++)
+	{
+		if (!strcmp(name, names[i]))
+			return i;
+	}
+
+	fprintf(stderr, "unknown option value '%s'\n", name);
+	usage();
+	return 0;
+}
+
+// comma separated names or numbers
+static std::vector<int>
+parseList(const char* value, const char* const names[], int numNames)
+{
+	std::vector<int>	list;
+	std::string			rest = value;
+
+	while (!rest.empty())
+	{
+		size_t		comma = rest.find(',');
+		std::string	item = rest.substr(0, comma);
+
+		if (names)
+			list.push_back(lookupName(item.c_str(), names, numNames));
+		else
+			list.push_back(atoi(item.c_str()));
+
+		rest = comma == std::string::npos ? "" : rest.substr(comma + 1);
+	}
+
+	return list;
+}
+
+
+//
+// corpora
+//
+
+static void
+addRGBFrame(Corpus& corpus, const uint8_t* rgb)
+{
+	std::vector<float>	rgba(corpus.width * corpus.height * 4);
+	size_t				rowSize = corpus.width * 3;
+
+	for (int y=0; y<corpus.height; y++)
+	{
+		const uint8_t*	src = &rgb[rowSize * (corpus.height - 1 - y)];
+		float*			dst = &rgba[4 * corpus.width * y];
+
+		for (int x=0; x<corpus.width; x++, src += 3, dst += 4)
+		{
+			dst[0] = src[0] / 255.0f;
+			dst[1] = src[1] / 255.0f;
+			dst[2] = src[2] / 255.0f;
+			dst[3] = 1.0f;
+		}
+	}
+
+	corpus.frames.push_back(rgba);
+}
+
+static bool
+loadRGB(Corpus& corpus, const char* path, int maxFrames)
+{
+	FILE*	input = fopen(path, "rb");
+	if (!input)
+	{
+		fprintf(stderr, "%s: can't open\n", path);
+		return false;
+	}
+
+	std::vector<uint8_t>	rgb(corpus.width * corpus.height * 3);
+
+	while ((int)corpus.frames.size() < maxFrames &&
+		   fread(rgb.data(), 1, rgb.size(), input) == rgb.size())
+	{
+		addRGBFrame(corpus, rgb.data());
+	}
+
+	fclose(input);
+
+	if (corpus.frames.empty())
+	{
+		fprintf(stderr, "%s: no %dx%d frames\n", path, corpus.width, corpus.height);
+		return false;
+	}
+
+	return true;
+}
+
+// Two fields make a picture: each has 5 of the 10 cells of a line, the
+// other 5 are in the next field. Cells are put back in file order, which
+// gives the encoder a real picture's colours and detail to work on.
+static bool
+loadMVC(Corpus& corpus, const char* path, int maxFrames)
+{
+	const int	fieldSize = 8 * 512;
+
+	FILE*	input = fopen(path, "rb");
+	if (!input)
+	{
+		fprintf(stderr, "%s: can't open\n", path);
+		return false;
+	}
+
+	std::vector<uint8_t>	fields(2 * fieldSize);
+	std::vector<uint8_t>	rgb;
+	unsigned char*			pal = nullptr;
+	int						palSize = 0;
+
+	while ((int)corpus.frames.size() < maxFrames &&
+		   fread(fields.data(), 1, fields.size(), input) == fields.size())
+	{
+		const uint8_t*	graph[2];
+		const uint8_t*	color[2];
+		const uint8_t*	bkcolor[2];
+		int				visible = 192;
+
+		for (int f=0; f<2; f++)
+		{
+			const uint8_t*	field = &fields[f * fieldSize];
+			int				totalLines;
+			bool			odd;
+
+			if (memcmp(field, "MVC", 4))
+			{
+				fprintf(stderr, "%s: not an mvc file\n", path);
+				fclose(input);
+				return false;
+			}
+
+			// see FrameFormat in firmware/frame.c
+			if (field[4] & 0x80)
+			{
+				visible = field[12];
+				totalLines = field[9] + field[10] + field[11] + visible;
+				odd = !(field[8] & 1);
+
+				graph[f] = field + 14 + totalLines;
+				color[f] = graph[f] + 5 * visible;
+				bkcolor[f] = color[f] + 5 * visible;
+
+				if (!corpus.frames.size() && !f)
+					corpus.palette = field[13] == 50 ? Palette_Atari2600PAL : Palette_Atari2600NTSC;
+			}
+			else
+			{
+				totalLines = 3 + 37 + 30 + visible;
+				odd = field[6] & 1;
+
+				graph[f] = field + 7 + totalLines;
+				color[f] = graph[f] + 5 * visible + 60;
+				bkcolor[f] = color[f] + 5 * visible;
+			}
+
+			if (odd)
+				bkcolor[f]++;
+		}
+
+		if (corpus.frames.empty())
+		{
+			corpus.width = 80;
+			corpus.height = visible;
+			rgb.resize(corpus.width * corpus.height * 3);
+			getPalette(corpus.palette, pal, palSize);
+		}
+		else if (visible != corpus.height)
+			break;
+
+		uint8_t*	dst = rgb.data();
+
+		for (int y=0; y<visible; y++)
+		{
+			for (int c=0; c<10; c++)
+			{
+				int			f = (c + y) & 1;
+				int			i = 5*y + c/2;
+				uint8_t		bits = graph[f][i];
+				const unsigned char*	fore = &pal[3 * ((color[f][i] >> 1) % palSize)];
+				const unsigned char*	back = &pal[3 * ((bkcolor[f][y] >> 1) % palSize)];
+
+				for (int x=0; x<8; x++, bits <<= 1, dst += 3)
+					memcpy(dst, (bits & 0x80) ? fore : back, 3);
+			}
+		}
+
+		addRGBFrame(corpus, rgb.data());
+	}
+
+	fclose(input);
+
+	if (corpus.frames.empty())
+	{
+		fprintf(stderr, "%s: no fields\n", path);
+		return false;
+	}
+
+	return true;
+}
+
+// smooth moving gradients with grain and a bright moving disc
+static void
+makeSynthetic(Corpus& corpus, int numFrames)
+{
+	corpus.name = "synthetic";
+	corpus.width = 80;
+	corpus.height = 192;
+	corpus.palette = Palette_Atari2600NTSC;
+
+	std::vector<uint8_t>	rgb(corpus.width * corpus.height * 3);
+	unsigned				seed = 1;
+
+	for (int f=0; f<numFrames; f++)
+	{
+		uint8_t*	dst = rgb.data();
+
+		for (int y=0; y<corpus.height; y++)
+		{
+			for (int x=0; x<corpus.width; x++, dst += 3)
+			{
+				float	c[3];
+
+				c[0] = 128 + 100 * sinf(x*0.07f + f*0.3f);
+				c[1] = 128 + 100 * cosf(y*0.05f - f*0.2f);
+				c[2] = 128 + 100 * sinf((x + y)*0.04f + f*0.1f);
+
+				for (int j=0; j<3; j++)
+				{
+					seed = seed * 1103515245u + 12345u;
+					c[j] += (int)((seed >> 16) % 41) - 20;
+				}
+
+				if ((x - 40 - f)*(x - 40 - f) + (y - 96)*(y - 96) < 400)
+				{
+					c[0] = 250;
+					c[1] = 240;
+					c[2] = 30;
+				}
+
+				for (int j=0; j<3; j++)
+					dst[j] = (uint8_t)(c[j] < 0 ? 0 : c[j] > 255 ? 255 : c[j]);
+			}
+		}
+
+		addRGBFrame(corpus, rgb.data());
+	}
+}
+
+
+//
+// micro
+//
+
+// runs func until gMinSeconds have gone by, ns per call
+template<class Func>
+static MicroResult
+timeMicro(const char* name, const char* unit, Func func)
+{
+	typedef std::chrono::steady_clock	Clock;
+
+	func();	// warm up
+
+	long long		iterations = 0;
+	long long		batch = 1;
+	double			seconds = 0;
+	Clock::time_point	start = Clock::now();
+
+	while (seconds < gMinSeconds)
+	{
+		for (long long i=0; i<batch; i++)
+			func();
+
+		iterations += batch;
+		batch *= 2;
+		seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	MicroResult	result = { name, unit, seconds * 1e9 / iterations, iterations };
+
+	fprintf(stderr, "  %-28s %12.1f ns/%s\n", name, result.ns, unit);
+	return result;
+}
+
+static std::vector<MicroResult>
+runMicro(const Corpus& corpus)
+{
+	std::vector<MicroResult>	results;
+
+	const float*	frame = corpus.frames[0].data();
+	int				width = corpus.width;
+	int				height = corpus.height;
+	int				y = height / 2;
+	const float*	line = &frame[4 * width * y];
+
+	unsigned char*	pal8;
+	int				palSize;
+	getPalette(corpus.palette, pal8, palSize);
+
+	std::vector<float>	fpal(3 * palSize);
+	float				planes[3][256] = {};
+
+	for (int i=0; i<palSize; i++)
+	{
+		for (int j=0; j<3; j++)
+		{
+			fpal[3*i + j] = pal8[3*i + j] / 255.0f;
+			planes[j][i] = fpal[3*i + j];
+		}
+	}
+
+	int16_t		planes16[3][256] = {};
+
+	for (int i=0; i<palSize; i++)
+	{
+		for (int j=0; j<3; j++)
+			planes16[j][i] = pal8[3*i + j];
+	}
+
+	const float	(*pal)[3] = (const float (*)[3])fpal.data();
+	int			stride = (palSize + 7) & ~7;
+	int			stride16 = (palSize + 15) & ~15;
+
+	int			candidates[256];
+	float		errors[256];
+	uint8_t		entries[256];
+
+	for (int i=0; i<palSize; i++)
+	{
+		candidates[i] = i;
+		entries[i] = i;
+	}
+
+	float	backColor[4] = { pal[0][0], pal[0][1], pal[0][2], 0 };
+
+	fprintf(stderr, "micro, %s, %s kernels:\n", corpus.name.c_str(), getColorKernelName());
+
+	results.push_back(timeMicro("colorDist", "line x palette", [&]()
+	{
+		float	total = 0;
+
+		for (int x=0; x<width; x++)
+		{
+			for (int i=0; i<palSize; i++)
+				total += colorDist(&line[4*x], pal[i]);
+		}
+
+		gSink = total;
+	}));
+
+	results.push_back(timeMicro("scoreForegrounds", "cell", [&]()
+	{
+		scoreForegrounds(line, 8, backColor, planes, candidates, palSize, HUGE_VAL, errors);
+		gSink = errors[0];
+	}));
+
+	std::vector<float>		colors(3 * width);
+	std::vector<uint8_t>	nearest(width);
+
+	for (int x=0; x<width; x++)
+	{
+		for (int j=0; j<3; j++)
+			colors[j*width + x] = line[4*x + j];
+	}
+
+	results.push_back(timeMicro("nearestColors", "line", [&]()
+	{
+		nearestColors(&colors[0], &colors[width], &colors[2*width], width, planes,
+					  entries, palSize, nearest.data());
+		gSink = nearest[0];
+	}));
+
+	std::vector<float>	dist(stride * width);
+
+	results.push_back(timeMicro("paletteDistances", "line", [&]()
+	{
+		paletteDistances(line, width, planes, stride, dist.data());
+		gSink = dist[0];
+	}));
+
+	results.push_back(timeMicro("sumMinDistances", "cell", [&]()
+	{
+		sumMinDistances(dist.data(), stride, 8, 0, errors);
+		gSink = errors[0];
+	}));
+
+	std::vector<uint16_t>	dist16(stride16 * width);
+
+	results.push_back(timeMicro("paletteDistances16", "line", [&]()
+	{
+		paletteDistances16(line, width, planes16, stride16, dist16.data());
+		gSink = dist16[0];
+	}));
+
+	results.push_back(timeMicro("sumMinDistances16", "cell", [&]()
+	{
+		sumMinDistances16(dist16.data(), stride16, 8, 0, errors);
+		gSink = errors[0];
+	}));
+
+	std::vector<float>	cell(line, line + 4 * 8);
+	float				foreColor[4] = { pal[palSize-1][0], pal[palSize-1][1], pal[palSize-1][2], 0 };
+	float				thresholds[8] = { 0.03f, 0.53f, 0.16f, 0.66f, 0.78f, 0.28f, 0.91f, 0.41f };
+
+	results.push_back(timeMicro("thresholdPixels", "cell", [&]()
+	{
+		memcpy(cell.data(), line, 4 * 8 * sizeof(float));
+		thresholdPixels(cell.data(), 8, foreColor, backColor, thresholds);
+		gSink = cell[0];
+	}));
+
+	PaletteLookup*	lookup = new PaletteLookup;
+
+	results.push_back(timeMicro("PaletteLookup::build", "palette", [&]()
+	{
+		lookup->build(pal, palSize);
+	}));
+
+	results.push_back(timeMicro("PaletteLookup::lookup", "line", [&]()
+	{
+		int		total = 0;
+
+		for (int x=0; x<width; x++)
+		{
+			const float*	p = &line[4*x];
+			total += lookup->lookup((int)(p[0] * 255), (int)(p[1] * 255), (int)(p[2] * 255));
+		}
+
+		gSink = (float)total;
+	}));
+
+	delete lookup;
+
+	// a field of a 48kHz tone, fed as the encoder asks for it
+	AudioEncoder		audio;
+	std::vector<float>	samples;
+	std::vector<uint8_t>	levels(262);
+	int					sampleIndex = 0;
+
+	audio.setup(48000, 262, 60);
+
+	results.push_back(timeMicro("AudioEncoder::encodeField", "field", [&]()
+	{
+		samples.resize(audio.getInputNeeded());
+		for (size_t i=0; i<samples.size(); i++, sampleIndex++)
+			samples[i] = 0.5f * sinf(sampleIndex * 0.0576f);
+
+		audio.push(samples.data(), (int)samples.size());
+		audio.encodeField(levels.data());
+		gSink = levels[0];
+	}));
+
+	// a whole execute without a background search, setup included, so
+	// mostly ditherLine once per line
+	Colorizer*			colorizer = new Colorizer;
+	ColorizeParams		params;
+	std::vector<uint8_t>	preview(width * height * 4);
+
+	params.palette = corpus.palette;
+	params.dither = true;
+	params.colorSearch = 0;
+
+	results.push_back(timeMicro("execute (search 0)", "frame", [&]()
+	{
+		colorizer->execute(params, frame, width, height);
+	}));
+
+	results.push_back(timeMicro("storeResults", "frame", [&]()
+	{
+		colorizer->storeResults(nullptr, params.cellSize);
+	}));
+
+	results.push_back(timeMicro("storeResults+preview", "frame", [&]()
+	{
+		colorizer->storeResults(preview.data(), params.cellSize);
+	}));
+
+	delete colorizer;
+
+	return results;
+}
+
+
+//
+// fields
+//
+
+static FieldsResult
+runFields(const Corpus& corpus, const ColorizeParams& params, int frames)
+{
+	typedef std::chrono::steady_clock	Clock;
+
+	Colorizer*	colorizer = new Colorizer;
+
+	// the first frame builds the palette lookup and storage
+	colorizer->execute(params, corpus.frames[0].data(), corpus.width, corpus.height);
+
+	Clock::time_point	start = Clock::now();
+
+	for (int i=0; i<frames; i++)
+	{
+		const std::vector<float>&	frame = corpus.frames[i % corpus.frames.size()];
+
+		colorizer->execute(params, frame.data(), corpus.width, corpus.height);
+		colorizer->storeResults(nullptr, params.cellSize);
+	}
+
+	double	seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	// Quality, untimed, as the mean colour distance of what the cart
+	// shows to the source over each corpus frame. Comparing it between
+	// precisions shows what the fixed point search costs.
+	std::vector<uint8_t>	preview(corpus.width * corpus.height * 4);
+	double					sqError = 0;
+	int						qualityFrames = std::min(frames, (int)corpus.frames.size());
+
+	for (int i=0; i<qualityFrames; i++)
+	{
+		const float*	frame = corpus.frames[i].data();
+
+		colorizer->execute(params, frame, corpus.width, corpus.height);
+		colorizer->storeResults(preview.data(), params.cellSize);
+
+		const Array2D<float[4]>&	resultBK = colorizer->getResultBK();
+
+		for (int y=0; y<corpus.height; y++)
+		{
+			for (int x=0; x<corpus.width; x++)
+			{
+				const float*	source = &frame[4 * (y*corpus.width + x)];
+				const uint8_t*	shown = &preview[4 * (y*corpus.width + x)];
+				float			color[3];
+
+				// the background is left transparent in the preview
+				if (shown[3])
+				{
+					color[0] = shown[2] / 255.0f;
+					color[1] = shown[1] / 255.0f;
+					color[2] = shown[0] / 255.0f;
+				}
+				else
+				{
+					color[0] = resultBK(0, y)[0];
+					color[1] = resultBK(0, y)[1];
+					color[2] = resultBK(0, y)[2];
+				}
+
+				sqError += colorDist(source, color);
+			}
+		}
+	}
+
+	sqError /= (double)qualityFrames * corpus.width * corpus.height;
+
+	delete colorizer;
+
+	FieldsResult	result;
+
+	result.corpus = &corpus;
+	result.palette = params.palette;
+	result.matrix = params.matrix;
+	result.colorSearch = params.colorSearch;
+	result.dither = params.dither;
+	result.threads = params.threads;
+	result.precision = params.precision;
+	result.frames = frames;
+	result.fieldsPerSec = seconds > 0 ? frames / seconds : 0.0;
+	result.psnr = sqError > 0 ? -10.0 * log10(sqError) : 99.0;
+
+	fprintf(stderr, "  %-20s %-13s %-14s S%d %s t%-2d %-7s %10.2f fields/sec %6.2f dB\n",
+			corpus.name.c_str(), gPaletteNames[result.palette], gMatrixNames[result.matrix],
+			result.colorSearch, result.dither ? "dither" : "flat  ", result.threads,
+			gPrecisionNames[result.precision], result.fieldsPerSec, result.psnr);
+
+	return result;
+}
+
+
+//
+// output
+//
+
+static void
+writeString(FILE* output, const std::string& s)
+{
+	fputc('"', output);
+
+	for (char c : s)
+	{
+		if (c == '"' || c == '\\')
+			fputc('\\', output);
+
+		if ((unsigned char)c < 0x20)
+			fprintf(output, "\\u%04x", c);
+		else
+			fputc(c, output);
+	}
+
+	fputc('"', output);
+}
+
+static void
+writeJSON(FILE* output, const std::vector<Corpus>& corpora, const std::vector<MicroResult>& micro,
+		  const std::vector<FieldsResult>& fields)
+{
+	fprintf(output, "{\n");
+	fprintf(output, "  \"kernels\": \"%s\",\n", getColorKernelName());
+	fprintf(output, "  \"cores\": %u,\n", std::thread::hardware_concurrency());
+
+	fprintf(output, "  \"corpora\": [");
+	for (size_t i=0; i<corpora.size(); i++)
+	{
+		fprintf(output, "%s\n    { \"name\": ", i ? "," : "");
+		writeString(output, corpora[i].name);
+		fprintf(output, ", \"width\": %d, \"height\": %d, \"frames\": %d, \"palette\": \"%s\" }",
+				corpora[i].width, corpora[i].height, (int)corpora[i].frames.size(),
+				gPaletteNames[corpora[i].palette]);
+	}
+	fprintf(output, "\n  ],\n");
+
+	fprintf(output, "  \"micro\": [");
+	for (size_t i=0; i<micro.size(); i++)
+	{
+		fprintf(output, "%s\n    { \"name\": \"%s\", \"unit\": \"%s\", \"ns\": %.2f, \"iterations\": %lld }",
+				i ? "," : "", micro[i].name, micro[i].unit, micro[i].ns, micro[i].iterations);
+	}
+	fprintf(output, "\n  ],\n");
+
+	fprintf(output, "  \"fields\": [");
+	for (size_t i=0; i<fields.size(); i++)
+	{
+		const FieldsResult&	r = fields[i];
+
+		fprintf(output, "%s\n    { \"corpus\": ", i ? "," : "");
+		writeString(output, r.corpus->name);
+		fprintf(output, ", \"palette\": \"%s\", \"matrix\": \"%s\", \"colorsearch\": %d, "
+				"\"dither\": %s, \"threads\": %d, \"precision\": \"%s\", \"frames\": %d, "
+				"\"fields_per_sec\": %.3f, \"psnr\": %.3f }",
+				gPaletteNames[r.palette], gMatrixNames[r.matrix], r.colorSearch,
+				r.dither ? "true" : "false", r.threads, gPrecisionNames[r.precision], r.frames,
+				r.fieldsPerSec, r.psnr);
+	}
+	fprintf(output, "\n  ]\n");
+
+	fprintf(output, "}\n");
+}
+
+
+int
+main(int argc, char** argv)
+{
+	const char*			outputPath = nullptr;
+	bool				doMicro = true;
+	bool				doFields = true;
+	int					numFrames = 16;
+	std::vector<int>	levels = { 0, 1, 2, 3, 4 };
+	std::vector<int>	matrices = { Matrix_FloydSteinberg, Matrix_JIN, Matrix_Atkinson };
+	std::vector<int>	palettes;
+	std::vector<int>	dithers = { 1 };
+	std::vector<int>	threadCounts = { 1, 0 };
+	std::vector<int>	precisions = { Precision_Float };
+	bool				corpusPalette = false;
+	std::vector<Corpus>	corpora;
+
+	for (int i=0; i<gNumPalettes; i++)
+		palettes.push_back(i);
+
+	std::vector<const char*>	inputs;
+
+	for (int i=1; i<argc; i++)
+	{
+		const char*	arg = argv[i];
+
+		if (arg[0] != '-' || !arg[1])
+		{
+			inputs.push_back(arg);
+			continue;
+		}
+
+		if (i + 1 >= argc)
+			usage();
+		const char*	value = argv[++i];
+
+		if (!strcmp(arg, "-o"))
+			outputPath = value;
+		else if (!strcmp(arg, "-x"))
+		{
+			static const char* const	names[] = { "micro", "fields", "all" };
+			int		layer = lookupName(value, names, 3);
+
+			doMicro = layer != 1;
+			doFields = layer != 0;
+		}
+		else if (!strcmp(arg, "-n"))
+			numFrames = atoi(value);
+		else if (!strcmp(arg, "-S"))
+			levels = parseList(value, nullptr, 0);
+		else if (!strcmp(arg, "-m"))
+			matrices = parseList(value, gMatrixNames, gNumMatrices);
+		else if (!strcmp(arg, "-p"))
+		{
+			corpusPalette = !strcmp(value, "corpus");
+			if (!corpusPalette)
+				palettes = parseList(value, gPaletteNames, gNumPalettes);
+		}
+		else if (!strcmp(arg, "-d"))
+			dithers = parseList(value, nullptr, 0);
+		else if (!strcmp(arg, "-t"))
+			threadCounts = parseList(value, nullptr, 0);
+		else if (!strcmp(arg, "-P"))
+			precisions = parseList(value, gPrecisionNames, gNumPrecisions);
+		else if (!strcmp(arg, "-T"))
+			gMinSeconds = atof(value);
+		else
+			usage();
+	}
+
+	if (numFrames < 1)
+		usage();
+
+	for (int level : levels)
+	{
+		if (level < 0 || level > 4)
+			usage();
+	}
+
+	// 0 is all cores, as for the encoder
+	std::vector<int>	counts;
+
+	for (int threads : threadCounts)
+	{
+		if (threads < 1)
+			threads = std::thread::hardware_concurrency();
+		if (threads < 1)
+			threads = 1;
+
+		bool	listed = false;
+		for (int count : counts)
+			listed |= count == threads;
+
+		if (!listed)
+			counts.push_back(threads);
+	}
+
+	threadCounts = counts;
+
+	for (const char* input : inputs)
+	{
+		Corpus		corpus;
+		std::string	path = input;
+		size_t		colon = path.rfind(':');
+		bool		ok;
+
+		corpus.palette = Palette_Atari2600NTSC;
+
+		if (colon != std::string::npos &&
+			sscanf(path.c_str() + colon + 1, "%dx%d", &corpus.width, &corpus.height) == 2)
+		{
+			path = path.substr(0, colon);
+			ok = corpus.width > 0 && corpus.height > 0 && loadRGB(corpus, path.c_str(), numFrames);
+		}
+		else
+			ok = loadMVC(corpus, path.c_str(), numFrames);
+
+		if (!ok)
+			return 1;
+
+		size_t	slash = path.find_last_of("/\\");
+		corpus.name = slash == std::string::npos ? path : path.substr(slash + 1);
+
+		corpora.push_back(std::move(corpus));
+	}
+
+	if (corpora.empty())
+	{
+		corpora.push_back(Corpus());
+		makeSynthetic(corpora.back(), numFrames);
+	}
+
+	std::vector<MicroResult>	micro;
+	std::vector<FieldsResult>	fields;
+
+	if (doMicro)
+		micro = runMicro(corpora[0]);
+
+	if (doFields)
+	{
+		fprintf(stderr, "fields:\n");
+
+		for (const Corpus& corpus : corpora)
+		{
+			std::vector<int>	corpusPalettes = palettes;
+			if (corpusPalette)
+				corpusPalettes = { corpus.palette };
+
+			for (int palette : corpusPalettes)
+			for (int matrix : matrices)
+			for (int level : levels)
+			for (int dither : dithers)
+			for (int threads : threadCounts)
+			for (int precision : precisions)
+			{
+				ColorizeParams	params;
+
+				params.palette = palette;
+				params.matrix = matrix;
+				params.colorSearch = level;
+				params.dither = dither != 0;
+				params.threads = threads;
+				params.precision = precision;
+
+				fields.push_back(runFields(corpus, params, numFrames));
+			}
+		}
+	}
+
+	FILE*	output = outputPath ? fopen(outputPath, "w") : stdout;
+	if (!output)
+	{
+		fprintf(stderr, "%s: can't create\n", outputPath);
+		return 1;
+	}
+
+	writeJSON(output, corpora, micro, fields);
+
+	if (output != stdout && fclose(output))
+	{
+		fprintf(stderr, "%s: write failed\n", outputPath);
+		return 1;
+	}
+
+	return 0;
+}
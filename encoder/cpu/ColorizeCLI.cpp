@@ -0,0 +1,777 @@
+/*
+
+   Headless command line encoder
+
+   Reads raw rgb24 frames (top row first, eg. from
+   ffmpeg -i movie.mp4 -vf scale=80:192 -f rawvideo -pix_fmt rgb24 -)
+   and writes the colorize results of every frame.
+
+   Each raw output record is, top line first:
+
+	graph[lines][cells]		foreground bits, first pixel in bit 7
+	color[lines][cells]		foreground colour, top 7 bits
+	bkcolor[lines]			background colour, top 7 bits
+
+   With -f mvc, 80 pixel wide frames are written as MovieCart fields
+   instead, see MVCWriter.h. -g downsamples larger frames to that size,
+   so the input can be left at its own resolution.
+
+   -a gives a title mono float audio to go with the fields, eg. from
+   ffmpeg -i movie.mp4 -f f32le -ac 1 -ar 48000 -, resampled to the line
+   rate and quantised to the cart's 4 bit levels, see AudioEncoder.h.
+
+   -M writes several standards from one read of the input, eg.
+   -M ntsc,pal,pal60,secam movie.rgb movie_%s.mvc. Frames are downsampled
+   once for each line count, then every standard quantises them on one
+   shared pool of threads. Input at -F frames a second is dropped or
+   repeated to each standard's 30 or 25.
+
+*/
+
+#include "AudioEncoder.h"
+#include "Colorizer.h"
+#include "MVCWriter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <math.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+struct Title
+{
+	const char*		input;
+	const char*		output;
+	const char*		audio;			// or null for silence
+};
+
+static ColorizeParams	gParams;
+static int				gWidth = 0;
+static int				gHeight = 0;
+static int				gMaxFrames = 0;
+static bool				gMVC = false;
+static int				gRate = 0;
+static double			gAudioRate = 48000;
+static int				gShaping = AudioShaping_First;
+static std::vector<std::string>	gStandards;
+static double			gFrameRate = 30;
+
+
+static void
+usage()
+{
+	fprintf(stderr,
+		"usage: colorize [options] input output [input output ...]\n"
+		"\n"
+		"  input           raw rgb24 frames, - for stdin\n"
+		"  output          colorize results per frame, - for stdout\n"
+		"\n"
+		"  -s WxH          input frame size (required)\n"
+		"  -g WxH          area downsample frames to this size first, eg. 80x192\n"
+		"  -p palette      ntsc, pal, secam, randomterrain, bw2, bw4, rgb, rubik, colecovision\n"
+		"  -c size         cell size (8)\n"
+		"  -d              dither\n"
+		"  -b bleed        error diffusion amount (1.0)\n"
+		"  -B              bleed during search\n"
+		"  -m matrix       floydsteinberg, jin, atkinson, or threshold bayer, bluenoise\n"
+		"  -S level        colour search 0-4 (2)\n"
+		"  -D ms           time budget per frame, lines searched up to -S to fit\n"
+		"  -e engine       colour search engine: direct, matrix (matrix)\n"
+		"  -P precision    matrix search distances: float, fixed16 (float)\n"
+		"  -t threads      worker threads per title, 0 for all cores (1)\n"
+		"  -n frames       stop after this many frames\n"
+		"  -f format       raw or mvc (raw)\n"
+		"  -r rate         mvc fields per second (60, 50 for pal and secam)\n"
+		"  -a audio        raw f32le mono audio for the next title, mvc only\n"
+		"  -A rate         audio sample rate (48000)\n"
+		"  -N shaping      audio noise shaping: none, first, second (first)\n"
+		"  -M standards    mvc for each of ntsc, pal, pal60, secam at once, eg. ntsc,pal,\n"
+		"                  output names have %%s for the standard\n"
+		"  -F fps          input frames per second with -M (30)\n"
+		"  -j jobs         titles encoded at once (1)\n");
+	exit(1);
+}
+
+static int
+lookupName(const char* name, const char* const names[], int numNames)
+{
+	for (int i=0; i<numNames; i++)
+	{
+		if (!strcmp(name, names[i]))
+			return i;
+	}
+
+	fprintf(stderr, "unknown option value '%s'\n", name);
+	usage();
+	return 0;
+}
+
+static int
+parsePalette(const char* name)
+{
+	// same order as the Palette_ enum
+	static const char* const names[] =
+	{
+		"ntsc", "bw2", "bw4", "rgb", "randomterrain", "rubik", "pal", "secam", "colecovision"
+	};
+
+	return lookupName(name, names, sizeof(names) / sizeof(names[0]));
+}
+
+static int
+parseMatrix(const char* name)
+{
+	static const char* const names[] = { "floydsteinberg", "jin", "atkinson", "bayer", "bluenoise" };
+
+	return lookupName(name, names, sizeof(names) / sizeof(names[0]));
+}
+
+static int
+parseSearchEngine(const char* name)
+{
+	static const char* const names[] = { "direct", "matrix" };
+
+	return lookupName(name, names, sizeof(names) / sizeof(names[0]));
+}
+
+static int
+parsePrecision(const char* name)
+{
+	static const char* const names[] = { "float", "fixed16" };
+
+	return lookupName(name, names, sizeof(names) / sizeof(names[0]));
+}
+
+static int
+parseShaping(const char* name)
+{
+	static const char* const names[] = { "none", "first", "second" };
+
+	return lookupName(name, names, sizeof(names) / sizeof(names[0]));
+}
+
+static double
+elapsedMs(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static int
+parseFormat(const char* name)
+{
+	static const char* const names[] = { "raw", "mvc" };
+
+	return lookupName(name, names, sizeof(names) / sizeof(names[0]));
+}
+
+static bool
+readFrame(FILE* input, uint8_t* rgb, float* rgba, int width, int height)
+{
+	size_t	rowSize = width * 3;
+
+	if (fread(rgb, 1, rowSize * height, input) != rowSize * height)
+		return false;
+
+	// TouchDesigner textures are bottom row first
+	for (int y=0; y<height; y++)
+	{
+		const uint8_t*	src = &rgb[rowSize * (height - 1 - y)];
+		float*			dst = &rgba[4 * width * y];
+
+		for (int x=0; x<width; x++, src += 3, dst += 4)
+		{
+			dst[0] = src[0] / 255.0f;
+			dst[1] = src[1] / 255.0f;
+			dst[2] = src[2] / 255.0f;
+			dst[3] = 1.0f;
+		}
+	}
+
+	return true;
+}
+
+// the audio of the next field, from what's left at the end of the file
+static bool
+encodeAudio(FILE* audio, AudioEncoder& encoder, std::vector<float>& samples, uint8_t* dst)
+{
+	int		needed = encoder.getInputNeeded();
+
+	samples.resize(needed);
+	int		count = (int)fread(samples.data(), sizeof(float), needed, audio);
+
+	encoder.push(samples.data(), count);
+	if (count < needed)
+		encoder.flush();
+
+	return encoder.encodeField(dst);
+}
+
+static void
+parseStandards(const char* value)
+{
+	gStandards.clear();
+
+	for (const char* p = value; *p; )
+	{
+		const char*	end = strchr(p, ',');
+		std::string	name = end ? std::string(p, end) : std::string(p);
+
+		int			palette;
+		MVCFormat	format;
+		if (!MVCWriter::getStandard(name.c_str(), palette, format))
+		{
+			fprintf(stderr, "unknown standard '%s'\n", name.c_str());
+			usage();
+		}
+
+		gStandards.push_back(name);
+		p = end ? end + 1 : p + name.size();
+	}
+
+	if (gStandards.empty())
+		usage();
+}
+
+static bool
+writeFrame(FILE* output, const Colorizer& colorizer)
+{
+	std::vector<uint8_t>	record(colorizer.getPackedSize());
+
+	colorizer.packResults(record.data());
+
+	return fwrite(record.data(), 1, record.size(), output) == record.size();
+}
+
+static bool
+encodeTitle(const Title& title)
+{
+	FILE*	input = strcmp(title.input, "-") ? fopen(title.input, "rb") : stdin;
+	if (!input)
+	{
+		fprintf(stderr, "%s: can't open\n", title.input);
+		return false;
+	}
+
+	FILE*	output = strcmp(title.output, "-") ? fopen(title.output, "wb") : stdout;
+	if (!output)
+	{
+		fprintf(stderr, "%s: can't create\n", title.output);
+		if (input != stdin)
+			fclose(input);
+		return false;
+	}
+
+	// large palette tables, keep off the stack
+	Colorizer*				colorizer = new Colorizer;
+	std::vector<uint8_t>	rgb(gWidth * gHeight * 3);
+	std::vector<float>		rgba(gWidth * gHeight * 4);
+
+	int						lines = gParams.gridHeight > 0 ? gParams.gridHeight : gHeight;
+	MVCFormat				format = MVCWriter::getFormat(gParams.palette, lines);
+	if (gRate)
+		format.rate = gRate;
+
+	MVCWriter				mvc;
+	bool					opened = true;
+	if (gMVC)
+	{
+		opened = mvc.open(output, format);
+		if (!opened)
+			fprintf(stderr, "%s: can't write %d lines as mvc\n", title.output, lines);
+	}
+
+	FILE*					audio = nullptr;
+	AudioEncoder			audioEncoder;
+	std::vector<float>		samples;
+	std::vector<uint8_t>	levels[2];
+	if (opened && title.audio)
+	{
+		audio = fopen(title.audio, "rb");
+		opened = audio != nullptr;
+		if (!opened)
+			fprintf(stderr, "%s: can't open\n", title.audio);
+
+		audioEncoder.setup(gAudioRate, format.getTotalLines(), format.rate, gShaping);
+		levels[0].resize(format.getTotalLines());
+		levels[1].resize(format.getTotalLines());
+	}
+
+	if (!opened)
+	{
+		mvc.close();
+		delete colorizer;
+		if (input != stdin)
+			fclose(input);
+		if (output != stdout)
+			fclose(output);
+		return false;
+	}
+
+	auto	start = std::chrono::steady_clock::now();
+	int		frames = 0;
+	bool	ok = true;
+
+	// stage totals over all frames
+	ColorizeStats	total;
+	double			readMs = 0;
+	double			writeMs = 0;
+	double			audioMs = 0;
+
+	while (!gMaxFrames || frames < gMaxFrames)
+	{
+		auto	stage = std::chrono::steady_clock::now();
+		if (!readFrame(input, rgb.data(), rgba.data(), gWidth, gHeight))
+			break;
+		readMs += elapsedMs(stage);
+
+		// a few rows at a time, stored as they're done
+		colorizer->executeStreaming(gParams, rgba.data(), gWidth, gHeight);
+
+		// past the end of the audio the fields fall silent
+		const uint8_t*	field[2] = { nullptr, nullptr };
+		if (audio)
+		{
+			stage = std::chrono::steady_clock::now();
+			for (int f=0; f<2; f++)
+			{
+				if (encodeAudio(audio, audioEncoder, samples, levels[f].data()))
+					field[f] = levels[f].data();
+			}
+			audioMs += elapsedMs(stage);
+		}
+
+		stage = std::chrono::steady_clock::now();
+		if (gMVC ? !mvc.writeFrame(*colorizer, field[0], field[1]) : !writeFrame(output, *colorizer))
+		{
+			fprintf(stderr, "%s: write failed\n", title.output);
+			ok = false;
+			break;
+		}
+		writeMs += elapsedMs(stage);
+
+		const ColorizeStats&	stats = colorizer->getStats();
+		total.setupMs += stats.setupMs;
+		total.searchMs += stats.searchMs;
+		total.ditherMs += stats.ditherMs;
+		total.storeMs += stats.storeMs;
+		total.lines += stats.lines;
+		total.candidates += stats.candidates;
+		total.cutoffs += stats.cutoffs;
+		total.lookups += stats.lookups;
+		total.searchLevel += stats.searchLevel;
+		total.lateLines += stats.lateLines;
+
+		frames++;
+	}
+
+	if (gMVC && !mvc.close())
+	{
+		fprintf(stderr, "%s: write failed\n", title.output);
+		ok = false;
+	}
+
+	double	seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	fprintf(stderr, "%s: %d frames, %.2f frames/sec\n", title.input, frames,
+			seconds > 0 ? frames / seconds : 0.0);
+
+	if (frames)
+	{
+		// search and dither add up over threads
+		fprintf(stderr, "%s: ms/frame read %.2f setup %.2f search %.2f dither %.2f store %.2f write %.2f\n",
+				title.input, readMs / frames, total.setupMs / frames, total.searchMs / frames,
+				total.ditherMs / frames, total.storeMs / frames, writeMs / frames);
+		if (audio)
+			fprintf(stderr, "%s: ms/frame audio %.3f\n", title.input, audioMs / frames);
+		fprintf(stderr, "%s: %.1f candidates/line, %.1f%% early exit, %.0f lookups/frame\n",
+				title.input, total.lines ? (double)total.candidates / total.lines : 0.0,
+				total.candidates ? 100.0 * total.cutoffs / total.candidates : 0.0,
+				(double)total.lookups / frames);
+		if (gParams.budgetMs > 0)
+			fprintf(stderr, "%s: search level %.2f, %.1f late lines/frame\n",
+					title.input, total.searchLevel / frames, (double)total.lateLines / frames);
+	}
+
+	delete colorizer;
+
+	if (audio)
+		fclose(audio);
+	if (input != stdin)
+		fclose(input);
+	if (output != stdout && fclose(output))
+		ok = false;
+
+	return ok;
+}
+
+// a standard written by encodeStandards()
+struct StandardOutput
+{
+	std::string			path;
+	FILE*				file = nullptr;
+	ColorizeParams		params;
+	MVCFormat			format;
+	Colorizer*			colorizer = nullptr;
+	MVCWriter			mvc;
+	int					grid = 0;			// shared frame it quantises
+	int					frames = 0;			// written so far
+	int					encoded = -1;		// input frame in the results
+	double				encodeMs = 0;
+
+	FILE*				audio = nullptr;
+	AudioEncoder		audioEncoder;
+	std::vector<float>	samples;
+	std::vector<uint8_t>	levels[2];
+};
+
+// the input downsampled to one line count, for every standard with it
+struct SharedGrid
+{
+	int					height;
+	Downsampler			downsampler;
+	std::vector<float>	frame;
+	int					filled = -1;		// input frame held
+};
+
+static bool
+encodeStandards(const Title& title)
+{
+	FILE*	input = strcmp(title.input, "-") ? fopen(title.input, "rb") : stdin;
+	if (!input)
+	{
+		fprintf(stderr, "%s: can't open\n", title.input);
+		return false;
+	}
+
+	int		threads = gParams.threads;
+	if (threads < 1)
+		threads = std::thread::hardware_concurrency();
+
+	std::shared_ptr<ThreadPool>	pool;
+	if (threads > 1)
+		pool = std::make_shared<ThreadPool>(threads);
+
+	int		gridWidth = gParams.gridWidth > 0 ? gParams.gridWidth : gWidth;
+	bool	ok = true;
+
+	std::vector<std::unique_ptr<StandardOutput>>	outputs;
+	std::vector<std::unique_ptr<SharedGrid>>		grids;
+
+	for (const std::string& name : gStandards)
+	{
+		StandardOutput*	out = new StandardOutput;
+		outputs.emplace_back(out);
+
+		// the shared frames are already the grid size
+		out->params = gParams;
+		out->params.gridWidth = 0;
+		out->params.gridHeight = 0;
+		MVCWriter::getStandard(name.c_str(), out->params.palette, out->format);
+
+		out->path = title.output;
+		out->path.replace(out->path.find("%s"), 2, name);
+
+		for (out->grid = 0; out->grid < (int)grids.size(); out->grid++)
+		{
+			if (grids[out->grid]->height == out->format.visible)
+				break;
+		}
+
+		if (out->grid == (int)grids.size())
+		{
+			SharedGrid*	grid = new SharedGrid;
+			grids.emplace_back(grid);
+
+			grid->height = out->format.visible;
+			grid->downsampler.setSize(gWidth, gHeight, gridWidth, grid->height);
+			grid->frame.resize(4 * gridWidth * grid->height);
+		}
+
+		out->colorizer = new Colorizer;
+		out->colorizer->setThreadPool(pool);
+
+		out->file = fopen(out->path.c_str(), "wb");
+		if (!out->file || !out->mvc.open(out->file, out->format))
+		{
+			fprintf(stderr, "%s: can't create\n", out->path.c_str());
+			ok = false;
+			break;
+		}
+
+		if (title.audio)
+		{
+			out->audio = fopen(title.audio, "rb");
+			if (!out->audio)
+			{
+				fprintf(stderr, "%s: can't open\n", title.audio);
+				ok = false;
+				break;
+			}
+
+			int		lines = out->format.getTotalLines();
+
+			out->audioEncoder.setup(gAudioRate, lines, out->format.rate, gShaping);
+			out->levels[0].resize(lines);
+			out->levels[1].resize(lines);
+		}
+	}
+
+	std::vector<uint8_t>	rgb(gWidth * gHeight * 3);
+	std::vector<float>		rgba(gWidth * gHeight * 4);
+
+	auto	start = std::chrono::steady_clock::now();
+	int		frames = 0;
+	double	readMs = 0;
+	double	scaleMs = 0;
+
+	while (ok && (!gMaxFrames || frames < gMaxFrames))
+	{
+		auto	stage = std::chrono::steady_clock::now();
+		if (!readFrame(input, rgb.data(), rgba.data(), gWidth, gHeight))
+			break;
+		readMs += elapsedMs(stage);
+
+		for (auto& outPtr : outputs)
+		{
+			StandardOutput&	out = *outPtr;
+			double			outRate = out.format.rate / 2.0;
+
+			// each of the standard's frames takes the nearest input frame
+			while (floor(out.frames * gFrameRate / outRate + 0.5) <= frames)
+			{
+				SharedGrid&		grid = *grids[out.grid];
+				const float*	src = rgba.data();
+
+				if (gridWidth != gWidth || grid.height != gHeight)
+				{
+					if (grid.filled != frames)
+					{
+						stage = std::chrono::steady_clock::now();
+						for (int y=0; y<grid.height; y++)
+							grid.downsampler.filterLine(rgba.data(), y, &grid.frame[4 * gridWidth * y]);
+						scaleMs += elapsedMs(stage);
+						grid.filled = frames;
+					}
+					src = grid.frame.data();
+				}
+
+				// repeated frames write the same results again
+				if (out.encoded != frames)
+				{
+					stage = std::chrono::steady_clock::now();
+					out.colorizer->executeStreaming(out.params, src, gridWidth, grid.height);
+					out.encodeMs += elapsedMs(stage);
+					out.encoded = frames;
+				}
+
+				const uint8_t*	field[2] = { nullptr, nullptr };
+				for (int f=0; f<2 && out.audio; f++)
+				{
+					if (encodeAudio(out.audio, out.audioEncoder, out.samples, out.levels[f].data()))
+						field[f] = out.levels[f].data();
+				}
+
+				if (!out.mvc.writeFrame(*out.colorizer, field[0], field[1]))
+				{
+					fprintf(stderr, "%s: write failed\n", out.path.c_str());
+					ok = false;
+					break;
+				}
+
+				out.frames++;
+			}
+		}
+
+		frames++;
+	}
+
+	double	seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	fprintf(stderr, "%s: %d frames, %.2f frames/sec\n", title.input, frames,
+			seconds > 0 ? frames / seconds : 0.0);
+	if (frames)
+	{
+		fprintf(stderr, "%s: ms/frame read %.2f downsample %.2f\n", title.input,
+				readMs / frames, scaleMs / frames);
+	}
+
+	for (auto& outPtr : outputs)
+	{
+		StandardOutput&	out = *outPtr;
+
+		if (!out.mvc.close())
+		{
+			fprintf(stderr, "%s: write failed\n", out.path.c_str());
+			ok = false;
+		}
+
+		if (out.frames)
+		{
+			fprintf(stderr, "%s: %d frames, ms/frame encode %.2f\n", out.path.c_str(), out.frames,
+					out.encodeMs / out.frames);
+		}
+
+		if (out.file && fclose(out.file))
+			ok = false;
+		if (out.audio)
+			fclose(out.audio);
+		delete out.colorizer;
+	}
+
+	if (input != stdin)
+		fclose(input);
+
+	return ok;
+}
+
+int
+main(int argc, char** argv)
+{
+	int					jobs = 1;
+	std::vector<Title>	titles;
+	const char*			nextAudio = nullptr;
+
+	for (int i=1; i<argc; i++)
+	{
+		const char*	arg = argv[i];
+
+		if (arg[0] != '-' || !arg[1])
+		{
+			if (i + 1 >= argc)
+				usage();
+
+			Title	title = { argv[i], argv[i+1], nextAudio };
+			titles.push_back(title);
+			nextAudio = nullptr;
+			i++;
+			continue;
+		}
+
+		// flags without a value
+		if (!strcmp(arg, "-d"))
+		{
+			gParams.dither = true;
+			continue;
+		}
+		if (!strcmp(arg, "-B"))
+		{
+			gParams.bleedSearch = true;
+			continue;
+		}
+
+		if (i + 1 >= argc)
+			usage();
+		const char*	value = argv[++i];
+
+		if (!strcmp(arg, "-s"))
+		{
+			if (sscanf(value, "%dx%d", &gWidth, &gHeight) != 2)
+				usage();
+		}
+		else if (!strcmp(arg, "-g"))
+		{
+			if (sscanf(value, "%dx%d", &gParams.gridWidth, &gParams.gridHeight) != 2 ||
+				gParams.gridWidth <= 0 || gParams.gridHeight <= 0)
+				usage();
+		}
+		else if (!strcmp(arg, "-p"))
+			gParams.palette = parsePalette(value);
+		else if (!strcmp(arg, "-c"))
+			gParams.cellSize = atoi(value);
+		else if (!strcmp(arg, "-b"))
+			gParams.bleed = (float)atof(value);
+		else if (!strcmp(arg, "-m"))
+			gParams.matrix = parseMatrix(value);
+		else if (!strcmp(arg, "-S"))
+			gParams.colorSearch = atoi(value);
+		else if (!strcmp(arg, "-D"))
+			gParams.budgetMs = (float)atof(value);
+		else if (!strcmp(arg, "-e"))
+			gParams.searchEngine = parseSearchEngine(value);
+		else if (!strcmp(arg, "-P"))
+			gParams.precision = parsePrecision(value);
+		else if (!strcmp(arg, "-t"))
+			gParams.threads = atoi(value);
+		else if (!strcmp(arg, "-n"))
+			gMaxFrames = atoi(value);
+		else if (!strcmp(arg, "-j"))
+			jobs = atoi(value);
+		else if (!strcmp(arg, "-f"))
+			gMVC = parseFormat(value) == 1;
+		else if (!strcmp(arg, "-r"))
+			gRate = atoi(value);
+		else if (!strcmp(arg, "-a"))
+			nextAudio = value;
+		else if (!strcmp(arg, "-A"))
+			gAudioRate = atof(value);
+		else if (!strcmp(arg, "-N"))
+			gShaping = parseShaping(value);
+		else if (!strcmp(arg, "-M"))
+		{
+			parseStandards(value);
+			gMVC = true;
+		}
+		else if (!strcmp(arg, "-F"))
+			gFrameRate = atof(value);
+		else
+			usage();
+	}
+
+	if (titles.empty() || gWidth <= 0 || gHeight <= 0 || gParams.cellSize < 1)
+		usage();
+
+	if (gAudioRate <= 0 || gFrameRate <= 0)
+		usage();
+	for (const Title& title : titles)
+	{
+		if (title.audio && !gMVC)
+			usage();
+		if (!gStandards.empty() && !strstr(title.output, "%s"))
+			usage();
+	}
+
+	if (gParams.colorSearch < 0 || gParams.colorSearch > 4 || gParams.budgetMs < 0)
+		usage();
+
+	// two fields of 5 cells a line
+	if (gMVC && (gParams.gridWidth > 0 ? gParams.gridWidth : gWidth) != 10 * gParams.cellSize)
+		usage();
+
+	if (jobs < 1)
+		jobs = 1;
+	if (jobs > (int)titles.size())
+		jobs = (int)titles.size();
+
+	// each worker takes the next title until all are done
+
+	std::atomic<int>	nextTitle(0);
+	std::atomic<int>	failures(0);
+
+	auto worker = [&]()
+	{
+		for (int t = nextTitle++; t < (int)titles.size(); t = nextTitle++)
+		{
+			if (!(gStandards.empty() ? encodeTitle(titles[t]) : encodeStandards(titles[t])))
+				failures++;
+		}
+	};
+
+	std::vector<std::thread>	threads;
+	for (int j=1; j<jobs; j++)
+		threads.push_back(std::thread(worker));
+
+	worker();
+
+	for (auto& thread : threads)
+		thread.join();
+
+	return failures ? 1 : 0;
+}
@@ -16,98 +16,13 @@
 
 using namespace TD;
 
+#include "AudioEncoder.h"
+#include "Colorizer.h"
+#include "MVCWriter.h"
+#include "SharedResults.h"
 
-// kd-tree structures
-/* Adapted from: https://rosettacode.org/wiki/K-d_tree */
-#define MAX_DIM 3
-
-struct kd_node_t
-{
-    float   val[MAX_DIM];
-    int     index;
-    struct  kd_node_t *left, *right;
-};
-
-template<class T>
-class Array2D
-{
-public:
-
-	Array2D()
-	{
-		width = height = 0;
-		mem = nullptr;
-	}
-
-	~Array2D()
-	{
-		setSize(0, 0);
-	}
-
-	void
-	setSize(int w, int h)
-	{
-		if (w != width || h != height)
-		{
-			width = w;
-			height = h;
-
-			if (mem)
-				delete [] mem;
-
-			if (w || h)
-				mem = new T[width * height];
-			else
-				mem = nullptr;
-
-			zero();
-		}
-	}
-
-	void
-	zero()
-	{
-		if (mem)
-			memset(mem, 0, width*height*sizeof(T));
-	}
-
-	T&
-	operator()(int x, int y)
-	{
-		return mem[y*width + x];
-	}
-
-	T&
-	operator()(int x, int y) const
-	{
-		return mem[y*width + x];
-	}
-
-	T*
-	getData()
-	{
-		return mem;
-	}
-
-	int
-	getWidth() const
-	{
-		return width;
-	}
-
-	int
-	getHeight() const
-	{
-		return height;
-	}
-
-private:
-
-	T*			mem;
-	int			width;
-	int			height;
-
-};
+#include <string>
+#include <vector>
 
 class ColorizeTOP : public TOP_CPlusPlusBase
 {
@@ -136,30 +51,29 @@ public:
 
 private:
 
+	void				startRecording(const char *path, int palette, int visible);
+	void				stopRecording();
+	void				encodeAudio(const OP_CHOPInput *chop, const MVCFormat& format, int shaping,
+							const uint8_t *fields[2]);
+
 	TOP_Context*		myContext;
 
-    void                setupStorage(int outputWidth, int outputHeight, int cellSize);
-    void                storeResults(uint8_t *destPixel, int cellSize);
-
-    Array2D<float[4]>	myMem;
-    Array2D<float[4]>	myMemBackup;
-    Array2D<uint8_t>	myResultGraph;
-    Array2D<uint8_t>	myResultColor;
-    Array2D<float[4]>	myResultBK;
-    Array2D<float[3]>	myFPal;
-
-    unsigned char *myLastPal;
-    uint8_t				myColorLookup[256][256][256];
-    void				buildColourMap();
-
-    void				ditherLine(int bidx, int y, bool finalB, int width, int height, int cellSize,
-							float *curY, int palSize, float bleed, int matrix,
-							bool dither, float *curError, float bestError,
-							int colorInc);
-
-    // k-d tree data
-    struct kd_node_t	kdtree[256];
-    struct kd_node_t*	kdtree_root{nullptr};
-    void				setup_kdtree(Array2D<float[3]>& fpal, int palSize);
+	Colorizer			myColorizer;
+	OP_SmartRef<OP_TOPDownloadResult>	myPendingDownload;	// next cook's input when pipelined
+	SharedResults		myShared;			// packed results for other processes
+	bool				myInfoDAT;			// also fill the Info DAT table
+
+	MVCWriter			myWriter;			// fields of every cook while recording
+	FILE*				myRecordFile;
+	std::string			myRecordPath;
+
+	AudioEncoder		myAudio;			// Audio CHOP to the fields' 4 bit levels
+	double				myAudioRate;		// it was set up for, 0 to start again
+	int					myAudioShaping;
+	std::vector<float>	myAudioMix;
+	std::vector<uint8_t>	myAudioLevels[2];
+
+	double				myDownloadMs;		// input download, including the getData() stall
+	double				myUploadMs;			// output buffer and upload
 
 };
@@ -0,0 +1,1907 @@
+/*
+
+   Colorize engine
+
+*/
+
+#include "Colorizer.h"
+#include "ColorKernels.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+typedef std::chrono::steady_clock	Clock;
+
+static inline double
+elapsedMs(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+inline uint8_t
+lookupClosestInPalette(float cellColor[4], Array2D<float[3]>& fpal, const PaletteLookup& lookup) 
+{
+    int r = (int)(cellColor[0] * 255.0f);
+    int g = (int)(cellColor[1] * 255.0f);
+    int b = (int)(cellColor[2] * 255.0f);
+    
+    int minIndex = lookup.lookup(r, g, b);
+
+    // stuff it all back in.
+
+    cellColor[0] = fpal(minIndex,0)[0];
+    cellColor[1] = fpal(minIndex,0)[1];
+    cellColor[2] = fpal(minIndex,0)[2];
+    cellColor[3] = (float)minIndex;
+
+	return minIndex;
+}
+
+inline void
+findClosest(float cellColor[4], const float* selectColor, const float* backColor)
+{
+	float distBlack = colorDist(cellColor, backColor);
+	float distWhite = colorDist(cellColor, selectColor);
+
+	if (distBlack < distWhite)
+	{
+		memcpy(cellColor, backColor, sizeof(float)*4);
+	}
+	else
+	{
+		memcpy(cellColor, selectColor, sizeof(float)*4);
+	}
+}
+
+// one error diffusion tap, clamped
+static inline void
+addError(float* npixel, const float* quantError, float ratio)
+{
+	npixel[0] += quantError[0] * ratio;
+	npixel[1] += quantError[1] * ratio;
+	npixel[2] += quantError[2] * ratio;
+
+	// clamp
+	for (int j=0; j<3; j++)
+	{
+		if (npixel[j] < 0)
+			npixel[j] = 0;
+		else if (npixel[j] > 1)
+			npixel[j] = 1;
+	}
+}
+
+// row is null past the bottom of the frame
+template <bool Checked>
+static inline void
+distributeError(int width, float* row, int x, const float* quantError, float ratio)
+{
+	if (!Checked || (row && x >=0 && x<width))
+		addError(&row[4 * x], quantError, ratio);
+}
+
+// dither without passing the error on
+static const int	Matrix_None = -1;
+
+// Matrix_Bayer and Matrix_BlueNoise, pixels compared with myThresholds
+static const int	Matrix_Threshold = -2;
+
+static inline bool
+isThresholdMatrix(int matrix)
+{
+	return matrix == Matrix_Bayer || matrix == Matrix_BlueNoise;
+}
+
+// colour search level 0-4 as the step between the background candidates
+// tried first, 0 for none
+static int
+searchStep(int level)
+{
+	int		colorInc = 1;
+
+	switch(level)
+	{
+		case 0: colorInc = 0; break;
+		case 1: colorInc = 8; break;
+		case 2: colorInc = 4; break;
+		case 3: colorInc = 2; break;
+		case 4: colorInc = 1; break;
+	}
+
+	return colorInc;
+}
+
+// palette entries in their own order
+static const struct IdentityOrder
+{
+	uint8_t		entries[256];
+
+	IdentityOrder()
+	{
+		for (int i=0; i<256; i++)
+			entries[i] = (uint8_t)i;
+	}
+} Identity;
+
+// roughly how much more a line costs at each search level than the one below
+static const float	SearchLevelGrowth[] = { 8.0f, 2.0f, 2.0f, 2.0f };
+
+// Bayer's recursive ordering, the lowest bits of the position count most
+static std::vector<float>
+makeBayer(int size, int bits)
+{
+	std::vector<float>	table(size * size);
+
+	for (int y=0; y<size; y++)
+	{
+		for (int x=0; x<size; x++)
+		{
+			int		rank = 0;
+
+			for (int k=0; k<bits; k++)
+				rank = rank * 4 + 2 * (((x ^ y) >> k) & 1) + ((y >> k) & 1);
+
+			table[y * size + x] = (rank + 0.5f) / (size * size);
+		}
+	}
+
+	return table;
+}
+
+// Void and cluster (Ulichney 1993): a sparse pattern is evened out, then
+// ranked by taking away its tightest clusters and filling its largest
+// voids, measured by a gaussian over the wrapped around neighbourhood.
+static std::vector<float>
+makeBlueNoise(int size)
+{
+	const int	Radius = 5;
+	const int	numPixels = size * size;
+
+	float	kernel[2*Radius + 1][2*Radius + 1];
+
+	for (int dy=-Radius; dy<=Radius; dy++)
+	{
+		for (int dx=-Radius; dx<=Radius; dx++)
+			kernel[dy + Radius][dx + Radius] = expf(-(dx*dx + dy*dy) / (2.0f * 1.5f * 1.5f));
+	}
+
+	std::vector<float>		energy(numPixels, 0.0f);
+	std::vector<uint8_t>	on(numPixels, 0);
+
+	auto toggle = [&](int i)
+	{
+		float	sign = on[i] ? -1.0f : 1.0f;
+		int		x = i % size;
+		int		y = i / size;
+
+		on[i] ^= 1;
+
+		for (int dy=-Radius; dy<=Radius; dy++)
+		{
+			int		row = ((y + dy + size) % size) * size;
+
+			for (int dx=-Radius; dx<=Radius; dx++)
+				energy[row + (x + dx + size) % size] += sign * kernel[dy + Radius][dx + Radius];
+		}
+	};
+
+	// highest energy of those on, or lowest of those off
+	auto find = [&](bool tightest) -> int
+	{
+		float	sign = tightest ? 1.0f : -1.0f;
+		float	bestScore = -HUGE_VALF;
+		int		best = -1;
+
+		for (int i=0; i<numPixels; i++)
+		{
+			float	score = sign * energy[i];
+
+			if (on[i] == tightest && score > bestScore)
+			{
+				bestScore = score;
+				best = i;
+			}
+		}
+
+		return best;
+	};
+
+	// a tenth on at random, always the same
+	int			numOn = numPixels / 10;
+	uint32_t	seed = 1;
+
+	for (int n=0; n<numOn; )
+	{
+		seed = seed * 1103515245 + 12345;
+
+		int		i = (seed >> 8) % numPixels;
+		if (!on[i])
+		{
+			toggle(i);
+			n++;
+		}
+	}
+
+	// move the tightest cluster to the largest void until it comes back
+	for (int n=0; n<numPixels; n++)
+	{
+		int		cluster = find(true);
+		toggle(cluster);
+
+		int		gap = find(false);
+		toggle(gap);
+
+		if (gap == cluster)
+			break;
+	}
+
+	std::vector<uint8_t>	initialOn = on;
+	std::vector<float>		initialEnergy = energy;
+	std::vector<int>		rank(numPixels);
+
+	for (int r=numOn-1; r>=0; r--)
+	{
+		int		cluster = find(true);
+		toggle(cluster);
+		rank[cluster] = r;
+	}
+
+	// past half full the tightest cluster of those off is the largest void,
+	// the neighbourhood's total being fixed
+	on = initialOn;
+	energy = initialEnergy;
+
+	for (int r=numOn; r<numPixels; r++)
+	{
+		int		gap = find(false);
+		toggle(gap);
+		rank[gap] = r;
+	}
+
+	std::vector<float>	table(numPixels);
+	for (int i=0; i<numPixels; i++)
+		table[i] = (rank[i] + 0.5f) / numPixels;
+
+	return table;
+}
+
+// furthest any matrix passes error, across and down
+static const int	MatrixGuard = 2;
+
+// rows kept when streaming, the one being dithered and those it passes error to
+static const int	StreamRows = MatrixGuard + 1;
+
+inline float*
+Colorizer::getWorkRow(int y)
+{
+	return myStreamInput ? myRows(0, y % StreamRows) : myMem(0, y);
+}
+
+template <int Matrix, bool Final, bool Checked>
+static inline void
+spreadErrorTaps(int width, float* curY, float* const* below, int x, const float* quantError)
+{
+	if (Matrix == Matrix_FloydSteinberg)
+	{
+		distributeError<Checked>(width, curY, x+1, quantError, 7.0f / 16.0f);
+
+		if (Final)
+		{
+			distributeError<Checked>(width, below[0], x-1, quantError, 3.0f / 16.0f);
+			distributeError<Checked>(width, below[0], x+0, quantError, 5.0f / 16.0f);
+			distributeError<Checked>(width, below[0], x+1, quantError, 1.0f / 16.0f);
+		}
+	}
+	else if (Matrix == Matrix_JIN)
+	{
+	#if 0
+			 -   -   X   7   5 
+			 3   5   7   5   3
+			 1   3   5   3   1
+	 #endif
+		distributeError<Checked>(width, curY, x+1, quantError, 7.0f / 48.0f);
+		distributeError<Checked>(width, curY, x+2, quantError, 5.0f / 48.0f);
+
+		if (Final)
+		{
+			distributeError<Checked>(width, below[0], x-2, quantError, 3.0f / 48.0f);
+			distributeError<Checked>(width, below[0], x-1, quantError, 5.0f / 48.0f);
+			distributeError<Checked>(width, below[0], x+0, quantError, 7.0f / 48.0f);
+			distributeError<Checked>(width, below[0], x+1, quantError, 5.0f / 48.0f);
+			distributeError<Checked>(width, below[0], x+2, quantError, 3.0f / 48.0f);
+
+			distributeError<Checked>(width, below[1], x-2, quantError, 1.0f / 48.0f);
+			distributeError<Checked>(width, below[1], x-1, quantError, 3.0f / 48.0f);
+			distributeError<Checked>(width, below[1], x+0, quantError, 5.0f / 48.0f);
+			distributeError<Checked>(width, below[1], x+1, quantError, 3.0f / 48.0f);
+			distributeError<Checked>(width, below[1], x+2, quantError, 1.0f / 48.0f);
+		}
+	}
+	else if (Matrix == Matrix_Atkinson) // (partial error distribution 6/8)
+	{
+	#if 0
+		-   X   1   1 
+		1   1   1
+		-   1
+   #endif
+		distributeError<Checked>(width, curY, x+1, quantError, 1.0f / 8.0f);
+		distributeError<Checked>(width, curY, x+2, quantError, 1.0f / 8.0f);
+
+		if (Final)
+		{
+			distributeError<Checked>(width, below[0], x-1, quantError, 1.0f / 8.0f);
+			distributeError<Checked>(width, below[0], x+0, quantError, 1.0f / 8.0f);
+			distributeError<Checked>(width, below[0], x+1, quantError, 1.0f / 8.0f);
+
+			distributeError<Checked>(width, below[1], x+0, quantError, 1.0f / 8.0f);
+		}
+	}
+}
+
+template <int Matrix, bool Final>
+static inline void
+spreadError(int width, bool guarded, float* curY, float* const* below, int x,
+			const float* quantError)
+{
+	// every tap lands in the frame away from its edges, or in the guard band
+	if (guarded || (x >= 2 && x + 2 < width && below[1]))
+		spreadErrorTaps<Matrix, Final, false>(width, curY, below, x, quantError);
+	else
+		spreadErrorTaps<Matrix, Final, true>(width, curY, below, x, quantError);
+}
+
+#define max(a,b)  ((a)>(b) ? (a):(b))
+#define min(a,b)  ((a)<(b) ? (a):(b))
+
+
+template <int Matrix, bool Dither, bool Search, bool Final, int CellSize>
+void
+Colorizer::ditherLineT(int bidx, int y, int width, int height, int cellSize,
+	float* curY, int palSize, float bleed, float* curError,
+	float bestError, int colorInc,
+	uint8_t* lineColor, const std::atomic<float>* sharedError,
+	int xStart, int xEnd, SearchCounters* counters)
+{
+	const int	cs = CellSize ? CellSize : cellSize;
+
+	float	cellColor[4] = { 1, 1, 1, 0 };
+	float	backColor[4];
+
+	backColor[0] = myFPal(bidx,0)[0];
+	backColor[1] = myFPal(bidx,0)[1];
+	backColor[2] = myFPal(bidx,0)[2];
+	backColor[3] = (float)bidx;
+
+	// the search dithers a scratch line, which always has the guard band,
+	// as does the ring of rows when streaming
+	bool	guarded = !Final || myStreamInput || myMem.getGuard() >= MatrixGuard;
+
+	// the two rows the error flows down into
+	float*	below[2] = { nullptr, nullptr };
+
+	if (Final)
+	{
+		for (int i=0; i<2; i++)
+		{
+			if (guarded || y + 1 + i < height)
+				below[i] = getWorkRow(y + 1 + i);
+		}
+	}
+
+	// the line's row of the threshold matrix
+	const float*	thresholds = nullptr;
+	if (Matrix == Matrix_Threshold)
+		thresholds = &myThresholds(0, y % myThresholds.getHeight());
+
+	*curError = 0.0f;
+
+	// a search pass without bleed only needs the error, so the line is
+	// left as it is and the caller needn't copy it
+	const bool	ReadOnly = !Final && Matrix == Matrix_None;
+
+	// false when the candidate can't win any more
+	auto ditherPixel = [&](int x) -> bool
+	{
+		float* pixel = &curY[4*x];
+		float  quantized[4];
+		float* out = ReadOnly ? quantized : pixel;
+
+		if (!Dither)
+		{
+			if (!ReadOnly)
+				memcpy(pixel, cellColor, 4*sizeof(float));
+			return true;
+		}
+
+		float current[3];
+		current[0] = pixel[0];
+		current[1] = pixel[1];
+		current[2] = pixel[2];
+
+		if (ReadOnly)
+			memcpy(quantized, pixel, 4*sizeof(float));
+
+		findClosest(out, cellColor, backColor);
+
+		*curError += colorDist(current, out);
+		if (!Final && *curError >= bestError)
+		{
+			counters->cutoffs++;
+			return false;
+		}
+
+		// other threads' best, ties are settled by the caller
+		if (sharedError && *curError > sharedError->load(std::memory_order_relaxed))
+		{
+			counters->cutoffs++;
+			return false;
+		}
+
+		if (Matrix != Matrix_None)
+		{
+			float quantError[3];
+
+			for (int i = 0; i < 3; i++)
+				quantError[i] = (current[i] - out[i]) * bleed;
+
+			spreadError<Matrix, Final>(width, guarded, curY, below, x, quantError);
+		}
+
+		return true;
+	};
+
+	// foregrounds are tried a run at a time, see getSearchOrder()
+	const uint8_t*	order;
+	const uint8_t*	place;
+	getSearchOrder(colorInc, order, place);
+
+	int		runs = Search ? (palSize + colorInc - 1) / colorInc : 0;
+
+	int xcell = xStart / cs;
+
+	for (int x=xStart; x<xEnd; x+=cs, xcell++)
+	{
+		// determine cell color
+
+		if (Search)
+		{
+			float	maxError = HUGE_VAL;
+			int		bestF = 0;
+
+			int		candidates[256];
+			float	errors[256];
+			int		numCandidates = 0;
+
+			// lowest error wins, the earliest candidate on a tie
+			auto testForegrounds = [&]()
+			{
+				scoreForegrounds(&curY[4*x], cs, backColor, myPalPlanes,
+								 candidates, numCandidates, maxError, errors);
+
+				for (int i=0; i<numCandidates; i++)
+				{
+					if (errors[i] < maxError)
+					{
+						maxError = errors[i];
+						bestF = candidates[i];
+					}
+				}
+			};
+
+			// start with best color from previous frame (+2% speed)
+			int		startRun = place[lineColor[xcell]] / colorInc;
+
+			for (int i=0; i<runs; i++)
+				candidates[numCandidates++] = order[(startRun + i) % runs * colorInc];
+
+			testForegrounds();
+
+			// now redo rest of the run
+			int b2 = place[bestF] & ~(colorInc-1);	// round down to nearest inc
+
+			numCandidates = 0;
+			for (int b=1; b<colorInc && b2 + b<palSize; b++)
+				candidates[numCandidates++] = order[b2 + b];
+
+			testForegrounds();
+
+			cellColor[0] = myFPal(bestF,0)[0];
+			cellColor[1] = myFPal(bestF,0)[1];
+			cellColor[2] = myFPal(bestF,0)[2];
+			cellColor[3] = bestF;
+		}
+		else // average
+		{
+			float	total_weight = 0.0f;
+
+			cellColor[0] = 0.0f;
+			cellColor[1] = 0.0f;
+			cellColor[2] = 0.0f;
+
+
+			for (int x2=0; x2<cs; x2++)
+			{
+				int x3 = x + x2;
+
+				float* npixel = &curY[4*x3];
+			
+				float r = npixel[0];
+				float g = npixel[1];
+				float b = npixel[2];
+
+				float weight = r*colorScales[0] + g*colorScales[1] + b*colorScales[2];
+				//
+				// weigh background minimally
+				{
+					float	dist = colorDist(npixel, backColor);
+					weight *= dist;
+				}
+
+				cellColor[0] += r*weight;
+				cellColor[1] += g*weight;
+				cellColor[2] += b*weight;
+
+				total_weight += weight;
+			}
+
+			if (total_weight)
+			{
+				cellColor[0] /= total_weight;
+				cellColor[1] /= total_weight;
+				cellColor[2] /= total_weight;
+			}
+		}
+
+		uint8_t i = lookupClosestInPalette(cellColor, myFPal, *myLookup);
+		lineColor[xcell] = i;
+		counters->lookups++;
+
+		// no pixel waits on another, the cell goes in one call
+		if (Matrix == Matrix_Threshold && Dither)
+		{
+			thresholdPixels(&curY[4*x], min(cs, xEnd - x), cellColor, backColor, &thresholds[x]);
+			continue;
+		}
+
+		// now dither, a whole cell unrolls when its size is fixed
+		if (x + cs <= xEnd)
+		{
+			for (int x2=0; x2<cs; x2++)
+			{
+				if (!ditherPixel(x + x2))
+					return;
+			}
+		}
+		else
+		{
+			for (int x2=x; x2<xEnd; x2++)
+			{
+				if (!ditherPixel(x2))
+					return;
+			}
+		}
+	}
+}
+
+template <int Matrix, bool Dither>
+Colorizer::DitherLineFunc
+Colorizer::pickDitherLine(bool finalB, bool search, int cellSize)
+{
+	if (cellSize == 8)
+	{
+		if (finalB)
+			return search ? &Colorizer::ditherLineT<Matrix, Dither, true, true, 8> :
+							&Colorizer::ditherLineT<Matrix, Dither, false, true, 8>;
+		else
+			return search ? &Colorizer::ditherLineT<Matrix, Dither, true, false, 8> :
+							&Colorizer::ditherLineT<Matrix, Dither, false, false, 8>;
+	}
+
+	if (finalB)
+		return search ? &Colorizer::ditherLineT<Matrix, Dither, true, true, 0> :
+						&Colorizer::ditherLineT<Matrix, Dither, false, true, 0>;
+	else
+		return search ? &Colorizer::ditherLineT<Matrix, Dither, true, false, 0> :
+						&Colorizer::ditherLineT<Matrix, Dither, false, false, 0>;
+}
+
+void
+Colorizer::ditherLine(int bidx, int y, bool finalB, int width, int height, int cellSize,
+	float* curY, int palSize, float bleed, int matrix,
+	bool dither, float* curError,
+	float bestError, int colorInc,
+	uint8_t* lineColor, const std::atomic<float>* sharedError,
+	int xStart, int xEnd, SearchCounters* counters)
+{
+	// pick the variant once for the line
+	DitherLineFunc	func;
+	bool			search = colorInc != 0;
+
+	if (dither && isThresholdMatrix(matrix))
+	{
+		// the search scores plain nearest colours, as without bleed
+		if (finalB)
+			func = pickDitherLine<Matrix_Threshold, true>(finalB, search, cellSize);
+		else
+			func = pickDitherLine<Matrix_None, true>(finalB, search, cellSize);
+	}
+	else if (dither && bleed > 0)
+	{
+		switch(matrix)
+		{
+			case Matrix_FloydSteinberg:
+			default:
+				func = pickDitherLine<Matrix_FloydSteinberg, true>(finalB, search, cellSize);
+				break;
+			case Matrix_JIN:
+				func = pickDitherLine<Matrix_JIN, true>(finalB, search, cellSize);
+				break;
+			case Matrix_Atkinson:
+				func = pickDitherLine<Matrix_Atkinson, true>(finalB, search, cellSize);
+				break;
+		}
+	}
+	else if (dither)
+		func = pickDitherLine<Matrix_None, true>(finalB, search, cellSize);
+	else
+		func = pickDitherLine<Matrix_None, false>(finalB, search, cellSize);
+
+	(this->*func)(bidx, y, width, height, cellSize, curY, palSize, bleed, curError, bestError,
+				  colorInc, lineColor, sharedError, xStart, xEnd, counters);
+}
+
+void
+Colorizer::scoreLine(int bidx, int y, int width, int height, int cellSize,
+	const float* curY, int palSize, bool dither, float* curError,
+	float bestError, int colorInc,
+	uint8_t* lineColor, const std::atomic<float>* sharedError,
+	SearchCounters* counters)
+{
+	DitherLineFunc	func;
+
+	if (dither)
+		func = pickDitherLine<Matrix_None, true>(false, colorInc != 0, cellSize);
+	else
+		func = pickDitherLine<Matrix_None, false>(false, colorInc != 0, cellSize);
+
+	// the search variants without a matrix never write the line
+	(this->*func)(bidx, y, width, height, cellSize, const_cast<float*>(curY), palSize, 0.0f,
+				  curError, bestError, colorInc, lineColor, sharedError, 0, width, counters);
+}
+
+static inline void
+sumMinDistancesT(const float* dist, int numColors, int numPixels, int backIdx, float* errors)
+{
+	sumMinDistances(dist, numColors, numPixels, backIdx, errors);
+}
+
+static inline void
+sumMinDistancesT(const uint16_t* dist, int numColors, int numPixels, int backIdx, float* errors)
+{
+	sumMinDistances16(dist, numColors, numPixels, backIdx, errors);
+}
+
+template <typename Dist>
+void
+Colorizer::ditherLineMatrix(int bidx, const Dist* dist, int distStride, int width,
+	int cellSize, int palSize, bool dither, float* curError, float bestError,
+	int colorInc, uint8_t* lineColor, const std::atomic<float>* sharedError,
+	const float* cellBound, SearchCounters* counters)
+{
+	// Without bleed a pixel keeps its value until it is dithered, so the
+	// same distances ditherLine works out for every candidate can be looked
+	// up. The foregrounds, and the error the search sees, come out the same.
+
+	float	errors[256];
+
+	const uint8_t*	order;
+	const uint8_t*	place;
+	getSearchOrder(colorInc, order, place);
+
+	int		runs = (palSize + colorInc - 1) / colorInc;
+
+	*curError = 0.0f;
+
+	for (int x=0, xcell=0; x<width; x+=cellSize, xcell++)
+	{
+		const Dist*		cellDist = &dist[x * distStride];
+
+		// The rest of the line can't come in under each pixel's nearest
+		// entry. The bound is shaved by more than the rounding of the sums,
+		// so a candidate that stops here would have lost.
+		if (cellBound && dither)
+		{
+			float	reach = (*curError + cellBound[xcell]) * 0.999f;
+
+			if (reach >= bestError ||
+				(sharedError && reach > sharedError->load(std::memory_order_relaxed)))
+			{
+				*curError = HUGE_VAL;
+				counters->cutoffs++;
+				return;
+			}
+		}
+
+		sumMinDistancesT(cellDist, distStride, cellSize, bidx, errors);
+
+		// same candidate order as ditherLine
+		float	maxError = HUGE_VAL;
+		int		bestF = 0;
+
+		int		startRun = place[lineColor[xcell]] / colorInc;
+
+		for (int i=0; i<runs; i++)
+		{
+			int		f = order[(startRun + i) % runs * colorInc];
+
+			if (errors[f] < maxError)
+			{
+				maxError = errors[f];
+				bestF = f;
+			}
+		}
+
+		// now redo rest of the run
+		int b2 = place[bestF] & ~(colorInc-1);	// round down to nearest inc
+
+		for (int b=1; b<colorInc && b2 + b<palSize; b++)
+		{
+			int		f = order[b2 + b];
+
+			if (errors[f] < maxError)
+			{
+				maxError = errors[f];
+				bestF = f;
+			}
+		}
+
+		int		foreIdx = myPalRemap[bestF];
+		lineColor[xcell] = foreIdx;
+
+		if (!dither)
+			continue;
+
+		for (int i=0; i<cellSize; i++, cellDist += distStride)
+		{
+			float	distBack = (float)cellDist[bidx];
+			float	distFore = (float)cellDist[foreIdx];
+
+			*curError += distBack < distFore ? distBack : distFore;
+			if (*curError >= bestError)
+			{
+				counters->cutoffs++;
+				return;
+			}
+
+			// other threads' best, ties are settled by the caller
+			if (sharedError && *curError > sharedError->load(std::memory_order_relaxed))
+			{
+				counters->cutoffs++;
+				return;
+			}
+		}
+	}
+}
+
+
+Colorizer::Colorizer()
+{
+	myLastPal = nullptr;
+	myPalSize = 0;
+	myStreamInput = nullptr;
+	myStreamDest = nullptr;
+	myStreamScaled = false;
+	myWidth = 0;
+	myHeight = 0;
+	mySharedPool = false;
+	myStoreMs = 0;
+	myThresholdMatrix = Matrix_None;
+	myPalOrder = Identity.entries;
+	myPalPlace = Identity.entries;
+
+	forgetCosts();
+}
+
+Colorizer::~Colorizer()
+{
+}
+
+void
+Colorizer::setThreadPool(const std::shared_ptr<ThreadPool>& pool)
+{
+	myPool = pool;
+	mySharedPool = pool != nullptr;
+}
+
+void
+Colorizer::setPalette(int palette)
+{
+	// cache palette
+
+    unsigned char*	pal;
+    int             palSize;
+    getPalette(palette, pal, palSize);
+    if (pal != myLastPal)
+    {
+        myLastPal = pal;
+        myPalSize = palSize;
+        myFPal.setSize(palSize, 1);
+
+        for (int i=0; i<palSize; i++)
+        {
+            myFPal(i, 0)[0] = pal[3*i + 0] / 255.0f;
+            myFPal(i, 0)[1] = pal[3*i + 1] / 255.0f;
+            myFPal(i, 0)[2] = pal[3*i + 2] / 255.0f;
+        }
+
+        memset(myPalPlanes, 0, sizeof(myPalPlanes));
+        memset(myPalPlanes16, 0, sizeof(myPalPlanes16));
+        for (int i=0; i<palSize && i<256; i++)
+        {
+            myPalPlanes[0][i] = myFPal(i, 0)[0];
+            myPalPlanes[1][i] = myFPal(i, 0)[1];
+            myPalPlanes[2][i] = myFPal(i, 0)[2];
+
+            myPalPlanes16[0][i] = pal[3*i + 0];
+            myPalPlanes16[1][i] = pal[3*i + 1];
+            myPalPlanes16[2][i] = pal[3*i + 2];
+        }
+
+        myLookup = PaletteLookup::get(&myFPal(0, 0), palSize);
+
+        // backgrounds from another palette can't be kept, and what lines
+        // cost to search here is yet to be seen
+        forgetBackgrounds();
+        forgetCosts();
+
+        // the Atari palettes' runs of 8 are already the shades of a hue
+        if (palette == Palette_Atari2600NTSC ||
+            palette == Palette_Atari2600RandomTerrain ||
+            palette == Palette_Atari2600PAL)
+        {
+            myPalOrder = Identity.entries;
+            myPalPlace = Identity.entries;
+        }
+        else
+        {
+            myPalOrder = myLookup->getClusterOrder();
+            myPalPlace = myLookup->getClusterPlace();
+        }
+
+        // a chosen foreground goes through the lookup again
+        for (int i=0; i<palSize && i<256; i++)
+        {
+            float	cellColor[4] = { myFPal(i, 0)[0], myFPal(i, 0)[1], myFPal(i, 0)[2], 0 };
+            myPalRemap[i] = lookupClosestInPalette(cellColor, myFPal, *myLookup);
+        }
+    }
+}
+
+void
+Colorizer::execute(const ColorizeParams& params, const float* rgba, int width, int height)
+{
+	Clock::time_point	start = Clock::now();
+
+	int		srcWidth = width;
+	bool	scaled = setupGrid(params, width, height);
+
+	// the guard band only ever takes error, clear it when it's new
+	if (myMem.setSize(width, height, MatrixGuard))
+		myMem.zero();
+
+	for (int y=0; y<height; y++)
+	{
+		if (scaled)
+			myDownsampler.filterLine(rgba, y, myMem(0, y));
+		else
+			memcpy(myMem(0, y), &rgba[4 * y * srcWidth], width * 4 * sizeof(float));
+	}
+
+	double	copyMs = elapsedMs(start);
+
+	quantize(params, width, height, copyMs);
+	myStats.setupMs += copyMs;
+}
+
+void
+Colorizer::executeInPlace(const ColorizeParams& params, float* rgba, int width, int height)
+{
+	Clock::time_point	start = Clock::now();
+
+	int		gridWidth = width;
+	int		gridHeight = height;
+
+	// downsampling needs somewhere else to put the frame
+	if (setupGrid(params, gridWidth, gridHeight))
+	{
+		execute(params, rgba, width, height);
+		return;
+	}
+
+	myMem.setExternal((float (*)[4])rgba, width, height);
+
+	quantize(params, width, height, elapsedMs(start));
+}
+
+void
+Colorizer::executeStreaming(const ColorizeParams& params, const float* rgba, int width, int height,
+	uint8_t *destMem)
+{
+	Clock::time_point	start = Clock::now();
+
+	// the whole frame isn't needed any more
+	myMem.setSize(0, 0);
+
+	myStreamScaled = setupGrid(params, width, height);
+
+	// enough rows for the error to flow down into, the guard band takes the
+	// error that runs off the sides
+	if (myRows.setSize(width, StreamRows, MatrixGuard))
+		myRows.zero();
+
+	myStreamInput = rgba;
+	myStreamDest = destMem;
+
+	quantize(params, width, height, elapsedMs(start));
+
+	myStreamInput = nullptr;
+	myStreamDest = nullptr;
+}
+
+void
+Colorizer::loadRow(int y, int width)
+{
+	if (myStreamScaled)
+		myDownsampler.filterLine(myStreamInput, y, getWorkRow(y));
+	else
+		memcpy(getWorkRow(y), &myStreamInput[4 * (size_t)y * width], width * 4 * sizeof(float));
+}
+
+bool
+Colorizer::setupGrid(const ColorizeParams& params, int& width, int& height)
+{
+	int		gridWidth = params.gridWidth > 0 ? params.gridWidth : width;
+	int		gridHeight = params.gridHeight > 0 ? params.gridHeight : height;
+
+	if (gridWidth == width && gridHeight == height)
+		return false;
+
+	myDownsampler.setSize(width, height, gridWidth, gridHeight);
+
+	width = gridWidth;
+	height = gridHeight;
+	return true;
+}
+
+void
+Colorizer::quantize(const ColorizeParams& params, int width, int height, double spentMs)
+{
+	Clock::time_point	start = Clock::now();
+
+	myWidth = width;
+	myHeight = height;
+
+    int palette = params.palette;
+    int cellSize = params.cellSize;
+
+    bool dither = params.dither;
+    float bleed = params.bleed;
+    bool bleedSearch = params.bleedSearch;
+
+    int matrix = params.matrix;
+
+    int colorSearch = params.colorSearch;
+	int colorInc = searchStep(colorSearch);
+
+	// with a budget colorSearch is the most any line gets
+	bool	adaptive = params.budgetMs > 0 && colorInc;
+	int		maxLevel = colorSearch < 1 ? 1 : colorSearch >= NumSearchLevels ? NumSearchLevels - 1 : colorSearch;
+
+	setPalette(palette);
+	int palSize = myPalSize;
+
+	int threads = params.threads;
+	if (threads < 1)
+		threads = std::thread::hardware_concurrency();
+	if (threads < 1)
+		threads = 1;
+
+	if (mySharedPool)
+		threads = myPool ? myPool->getNumThreads() : 1;
+	else if (threads == 1)
+		myPool.reset();
+	else if (!myPool || myPool->getNumThreads() != threads)
+		myPool.reset(new ThreadPool(threads));
+
+	// Without bleed along the line the search only needs every pixel's
+	// distance to every palette entry, worked out once per line. Partial
+	// cells at the end of a line are left to ditherLine.
+	float	searchBleed = bleedSearch && !isThresholdMatrix(matrix) ? bleed : 0.0f;
+	int		distStride = 0;
+	bool	fixedDist = params.precision == Precision_Fixed16;
+
+	if (params.searchEngine == SearchEngine_Matrix && colorInc &&
+		(!dither || searchBleed <= 0) && width >= cellSize && width % cellSize == 0)
+	{
+		distStride = fixedDist ? (palSize + 15) & ~15 : (palSize + 7) & ~7;
+	}
+
+	setupStorage(width, height, cellSize, threads, distStride, fixedDist);
+	setupThresholds(dither ? matrix : Matrix_None, width);
+
+	for (SearchCounters& counters : myCounters)
+		counters = SearchCounters();
+
+	myStats.setupMs = elapsedMs(start);
+	myStats.lines = colorInc ? height : 0;
+	myStats.searchLevel = 0;
+	myStats.lateLines = 0;
+
+	// The budget is for the whole frame, from the execute call, with the
+	// last storeResults() taken as what this frame's will take. Streamed
+	// frames store as they go.
+	double	deadlineMs = params.budgetMs - spentMs - (myStreamInput ? 0.0 : myStoreMs);
+
+	// Frames have taken more or less than the estimates of their lines,
+	// with the time between lines too, so the plan keeps back what they
+	// have taken over them, and twice its spread. Misses are as much
+	// across whole frames as in single lines, so this is what keeps the
+	// lines at the bottom from being the ones dropped.
+	double	varianceMs = myFrameMissSq - myFrameMiss * myFrameMiss;
+	double	spreadMs = varianceMs > 0 ? sqrt(varianceMs) : 0.0;
+	double	marginMs = myFrameMiss + 2.0 * spreadMs;
+	double	plannedMs = 0;
+
+	if (adaptive)
+		planSearch(height, maxLevel, deadlineMs - myStats.setupMs - (marginMs > 0 ? marginMs : 0));
+
+	auto finishLine = [&](int y, int bidx, float* curY, int thread, int colorInc)
+	{
+		Clock::time_point	lineStart = Clock::now();
+		float	curError;
+		bool	finalB = true;
+
+		ditherLine(bidx, y, finalB, width, height, cellSize, curY, palSize, bleed,
+						 matrix, dither, &curError, HUGE_VAL, colorInc, &myResultColor(0, y), nullptr,
+						 0, width, &myCounters[thread]);
+
+		myCounters[thread].ditherMs += elapsedMs(lineStart);
+	};
+
+	auto searchLine = [&](int y, int thread, bool parallelSearch, int colorInc) -> float
+	{
+		Clock::time_point	lineStart = Clock::now();
+		float* curY = getWorkRow(y);
+
+		int		bestB = 0;
+		float	bestError = HUGE_VAL;
+
+		if (distStride && fixedDist)
+		{
+			uint16_t*	dist = &myLineDist16(0, thread);
+			paletteDistances16(curY, width, myPalPlanes16, distStride, dist);
+
+			searchBackground(y, thread, curY, width, height, cellSize, palSize, searchBleed, matrix,
+							 dither, colorInc, dist, distStride, parallelSearch, &bestB, &bestError);
+		}
+		else
+		{
+			float*	dist = nullptr;
+			if (distStride)
+			{
+				dist = &myLineDist(0, thread);
+				paletteDistances(curY, width, myPalPlanes, distStride, dist);
+			}
+
+			searchBackground(y, thread, curY, width, height, cellSize, palSize, searchBleed, matrix,
+							 dither, colorInc, dist, distStride, parallelSearch, &bestB, &bestError);
+		}
+
+		myCounters[thread].searchMs += elapsedMs(lineStart);
+
+		// redo best color
+		{
+			int		bidx = bestB;
+			finishLine(y, bidx, curY, thread, colorInc);
+
+			myResultBK(0, y)[0] = myFPal(bidx,0)[0];
+			myResultBK(0, y)[1] = myFPal(bidx,0)[1];
+			myResultBK(0, y)[2] = myFPal(bidx,0)[2];
+			myResultBK(0, y)[3] = (float)bidx;
+		}
+
+		return bestError;
+	};
+
+	// With a budget lines go in order at their planned level. One that
+	// would leave too little time for the rest at their lowest level drops
+	// to its own. Lines not run at their lowest level yet are reserved for
+	// at the average, which each line's time updates as it's done.
+	double	reserveMs = 0;
+	int		reserveLines[2] = { 0, 0 };
+
+	if (adaptive)
+	{
+		for (int y = 0; y < height; y++)
+		{
+			int		lowest = getLowestLevel(y);
+			float	cost = myLineCost[y * NumSearchLevels + lowest];
+
+			if (cost > 0)
+				reserveMs += cost;
+			else
+				reserveLines[lowest]++;
+		}
+	}
+
+	auto budgetLine = [&](int y)
+	{
+		int		level = myLineLevel[y];
+		int		lowest = getLowestLevel(y);
+		float	cost = myLineCost[y * NumSearchLevels + lowest];
+
+		if (cost > 0)
+			reserveMs -= cost;
+		else
+			reserveLines[lowest]--;
+
+		double	restMs = reserveMs + reserveLines[0] * estimateLevelCost(0) +
+						 reserveLines[1] * estimateLevelCost(1);
+
+		if (level > lowest && elapsedMs(start) + estimateLineCost(y, level) + restMs > deadlineMs)
+		{
+			level = lowest;
+			myStats.lateLines++;
+		}
+
+		Clock::time_point	lineStart = Clock::now();
+
+		if (level)
+			myLineError[y] = searchLine(y, 0, myPool != nullptr, searchStep(level));
+		else
+			finishLine(y, (int)myResultBK(0, y)[3], getWorkRow(y), 0, searchStep(1));
+
+		double	lineMs = elapsedMs(lineStart);
+
+		plannedMs += estimateLineCost(y, level);
+		myLineLevel[y] = (uint8_t)level;
+		updateLineCost(y, level, (float)lineMs);
+	};
+
+	// error only flows down into the next rows when dithering with bleed
+	bool	rowsIndependent = !dither || bleed <= 0 || isThresholdMatrix(matrix);
+
+	if (myStreamInput)
+	{
+		// Lines in order, each stored as soon as it's done, so its slot can
+		// take the line two below. A line's search still has the whole pool.
+		double	storeMs = 0;
+
+		if (!colorInc)
+			forgetBackgrounds();
+
+		Clock::time_point	loadStart = Clock::now();
+
+		for (int y = 0; y < height && y < StreamRows - 1; y++)
+			loadRow(y, width);
+
+		double	loadMs = elapsedMs(loadStart);
+
+		for (int y = 0; y < height; y++)
+		{
+			if (y + StreamRows - 1 < height)
+			{
+				loadStart = Clock::now();
+				loadRow(y + StreamRows - 1, width);
+				loadMs += elapsedMs(loadStart);
+			}
+
+			if (adaptive)
+				budgetLine(y);
+			else if (colorInc)
+				searchLine(y, 0, myPool != nullptr, colorInc);
+			else
+				finishLine(y, 0, getWorkRow(y), 0, colorInc);
+
+			Clock::time_point	storeStart = Clock::now();
+			storeLine(y, getWorkRow(y), myStreamDest, cellSize);
+			storeMs += elapsedMs(storeStart);
+		}
+
+		myStats.storeMs = storeMs;
+		myStats.setupMs += loadMs;
+	}
+	else if (!colorInc)
+	{
+		forgetBackgrounds();
+
+		if (myPool && rowsIndependent)
+		{
+			myPool->parallelFor(height, [&](int y, int thread)
+			{
+				finishLine(y, 0, myMem(0, y), thread, colorInc);
+			});
+		}
+		else if (myPool)
+		{
+			finishFrameWavefront(width, height, cellSize, palSize, bleed, matrix, dither);
+		}
+		else
+		{
+			for (int y = 0; y < height; y++)
+			{
+				float* curY = myMem(0, y);
+				int		bidx = 0;
+				finishLine(y, bidx, curY, 0, colorInc);
+			}
+		}
+	}
+	else if (adaptive)
+	{
+		for (int y = 0; y < height; y++)
+			budgetLine(y);
+	}
+	else
+	{
+		if (myPool && rowsIndependent)
+		{
+			// whole lines per thread, each searched as it would be serially
+			myPool->parallelFor(height, [&](int y, int thread)
+			{
+				searchLine(y, thread, false, colorInc);
+			});
+		}
+		else
+		{
+			// each line's search needs the finished error of the lines above
+			for (int y = 0; y < height; y++)
+				searchLine(y, 0, myPool != nullptr, colorInc);
+		}
+	}
+
+	if (adaptive)
+	{
+		int		levelSum = 0;
+
+		myStats.lines = 0;
+
+		for (int y = 0; y < height; y++)
+		{
+			levelSum += myLineLevel[y];
+			myStats.lines += myLineLevel[y] != 0;
+		}
+
+		myStats.searchLevel = (float)levelSum / height;
+
+		float	miss = (float)(elapsedMs(start) - myStats.setupMs - plannedMs);
+
+		myFrameMiss = 0.8f * myFrameMiss + 0.2f * miss;
+		myFrameMissSq = 0.8f * myFrameMissSq + 0.2f * miss * miss;
+	}
+
+	// line times add up over the threads running lines
+	myStats.searchMs = 0;
+	myStats.ditherMs = 0;
+	myStats.candidates = 0;
+	myStats.cutoffs = 0;
+	myStats.lookups = 0;
+
+	for (const SearchCounters& counters : myCounters)
+	{
+		myStats.searchMs += counters.searchMs;
+		myStats.ditherMs += counters.ditherMs;
+		myStats.candidates += counters.candidates;
+		myStats.cutoffs += counters.cutoffs;
+		myStats.lookups += counters.lookups;
+	}
+}
+
+void
+Colorizer::forgetBackgrounds()
+{
+	myResultBK.zero();
+	std::fill(myLineError.begin(), myLineError.end(), -1.0f);
+}
+
+int
+Colorizer::getLowestLevel(int y) const
+{
+	// level 0 keeps the line's last background, which it has to have
+	return myLineError[y] < 0 ? 1 : 0;
+}
+
+float
+Colorizer::estimateLineCost(int y, int level) const
+{
+	float	cost = myLineCost[y * NumSearchLevels + level];
+
+	return cost > 0 ? cost : estimateLevelCost(level);
+}
+
+float
+Colorizer::estimateLevelCost(int level) const
+{
+	float	cost;
+
+	// an average line, from the nearest level that's been measured
+	for (int d=0; d<NumSearchLevels; d++)
+	{
+		if (level - d >= 0 && myLevelCost[level - d] > 0)
+		{
+			cost = myLevelCost[level - d];
+			for (int l=level - d; l<level; l++)
+				cost *= SearchLevelGrowth[l];
+			return cost;
+		}
+
+		if (level + d < NumSearchLevels && myLevelCost[level + d] > 0)
+		{
+			cost = myLevelCost[level + d];
+			for (int l=level + d; l>level; l--)
+				cost /= SearchLevelGrowth[l - 1];
+			return cost;
+		}
+	}
+
+	return 0;
+}
+
+void
+Colorizer::forgetCosts()
+{
+	std::fill(myLineCost.begin(), myLineCost.end(), 0.0f);
+
+	for (float& cost : myLevelCost)
+		cost = 0;
+
+	myFrameMiss = 0;
+	myFrameMissSq = 0;
+}
+
+void
+Colorizer::updateLineCost(int y, int level, float ms)
+{
+	float&	lineCost = myLineCost[y * NumSearchLevels + level];
+	float&	levelCost = myLevelCost[level];
+
+	lineCost = lineCost > 0 ? 0.5f * (lineCost + ms) : ms;
+	levelCost = levelCost > 0 ? 0.9f * levelCost + 0.1f * ms : ms;
+}
+
+void
+Colorizer::planSearch(int height, int maxLevel, double budgetMs)
+{
+	if ((int)myLineError.size() != height)
+	{
+		myLineCost.resize(height * NumSearchLevels);
+		myLineError.assign(height, -1.0f);
+		forgetCosts();
+	}
+
+	myLineLevel.resize(height);
+
+	// nothing to go on, the first frame is searched at level 1 to find out
+	if (estimateLevelCost(1) <= 0)
+	{
+		std::fill(myLineLevel.begin(), myLineLevel.end(), (uint8_t)1);
+		return;
+	}
+
+	double	total = 0;
+	for (int y=0; y<height; y++)
+	{
+		myLineLevel[y] = (uint8_t)getLowestLevel(y);
+		total += estimateLineCost(y, myLineLevel[y]);
+	}
+
+	// the same level everywhere, as high as fits
+	for (int level=1; level<=maxLevel; level++)
+	{
+		double	levelTotal = 0;
+		for (int y=0; y<height; y++)
+			levelTotal += estimateLineCost(y, level > myLineLevel[y] ? level : myLineLevel[y]);
+
+		if (levelTotal > budgetMs)
+			break;
+
+		total = levelTotal;
+		for (uint8_t& lineLevel : myLineLevel)
+			lineLevel = level > lineLevel ? (uint8_t)level : lineLevel;
+	}
+
+	// then the lines that came out worst last time a level up at a time,
+	// while there's time left
+	myLineOrder.resize(height);
+	for (int y=0; y<height; y++)
+		myLineOrder[y] = y;
+
+	std::stable_sort(myLineOrder.begin(), myLineOrder.end(),
+		[this](int a, int b) { return myLineError[a] > myLineError[b]; });
+
+	for (bool raised = true; raised; )
+	{
+		raised = false;
+
+		for (int y : myLineOrder)
+		{
+			int		level = myLineLevel[y];
+
+			if (level >= maxLevel)
+				continue;
+
+			double	extra = estimateLineCost(y, level + 1) - estimateLineCost(y, level);
+
+			if (total + extra > budgetMs)
+				continue;
+
+			total += extra;
+			myLineLevel[y]++;
+			raised = true;
+		}
+	}
+}
+
+void
+Colorizer::finishFrameWavefront(int width, int height, int cellSize, int palSize, float bleed,
+	int matrix, bool dither)
+{
+	// Without a background search a line only needs the lines above to be
+	// far enough ahead. A cell reads its own pixels, and the lines above
+	// write up to 2 pixels either side of the one they are on, so they must
+	// be at least 4 pixels past the end of the cell for the error to arrive
+	// in the same order as a top to bottom pass.
+
+	const int	lead = 4;
+
+	std::vector<std::atomic<int>>	progress(height);
+	for (int y = 0; y < height; y++)
+		progress[y].store(0);
+
+	myPool->parallelFor(height, [&](int y, int thread)
+	{
+		Clock::time_point	lineStart = Clock::now();
+		float*	curY = myMem(0, y);
+
+		for (int x0 = 0; x0 < width; x0 += cellSize)
+		{
+			int		x1 = min(x0 + cellSize, width);
+
+			if (y > 0)
+			{
+				int		need = min(x1 + lead, width);
+
+				while (progress[y-1].load(std::memory_order_acquire) < need)
+					std::this_thread::yield();
+			}
+
+			float	curError;
+
+			ditherLine(0, y, true, width, height, cellSize, curY, palSize, bleed,
+					   matrix, dither, &curError, HUGE_VAL, 0, &myResultColor(0, y), nullptr,
+					   x0, x1, &myCounters[thread]);
+
+			progress[y].store(x1, std::memory_order_release);
+		}
+
+		// includes waiting on the line above
+		myCounters[thread].ditherMs += elapsedMs(lineStart);
+	});
+}
+
+template <typename Dist>
+void
+Colorizer::searchBackground(int y, int thread, const float* curY, int width, int height, int cellSize,
+	int palSize, float bleed, int matrix, bool dither, int colorInc,
+	const Dist* dist, int distStride, bool parallel, int* bestB, float* bestError)
+{
+	int		cells = myResultColor.getWidth();
+
+	// every candidate starts its foreground search from the previous frame,
+	// so the result doesn't depend on which candidates ran, or in what order
+	const uint8_t*	prevColor = &myResultColor(0, y);
+
+	// The distance of each pixel to its nearest palette entry is the least
+	// error any candidate can still add from a cell to the end of the line.
+	// The entries past the palette can only make the bound lower.
+	float*	cellBound = nullptr;
+
+	if (dist && dither)
+	{
+		cellBound = &myCellBound(0, thread);
+
+		double	rest = 0.0;
+
+		cellBound[cells] = 0.0f;
+		for (int xcell=cells-1; xcell>=0; xcell--)
+		{
+			for (int x=xcell*cellSize; x<(xcell+1)*cellSize; x++)
+			{
+				const Dist*		row = &dist[x * distStride];
+				Dist			nearest[8];
+
+				for (int j=0; j<8; j++)
+					nearest[j] = row[j];
+
+				for (int i=8; i<distStride; i+=8)
+				{
+					for (int j=0; j<8; j++)
+						nearest[j] = row[i + j] < nearest[j] ? row[i + j] : nearest[j];
+				}
+
+				for (int j=1; j<8; j++)
+					nearest[0] = nearest[j] < nearest[0] ? nearest[j] : nearest[0];
+
+				rest += nearest[0];
+			}
+
+			cellBound[xcell] = (float)rest;
+		}
+	}
+
+	// try the colours most pixels are nearest to first, so the cutoff
+	// tightens after the first few candidates
+	int		histogram[256] = {};
+
+	if (dither)
+	{
+		for (int x=0; x<width; x++)
+		{
+			int		rgb[3];
+
+			for (int j=0; j<3; j++)
+				rgb[j] = min(max((int)(curY[4*x + j] * 255.0f), 0), 255);
+
+			histogram[myLookup->lookup(rgb[0], rgb[1], rgb[2])]++;
+		}
+
+		myCounters[thread].lookups += width;
+	}
+
+	Candidate	candidates[256];
+	int			bestRank = 0x7fffffff;
+
+	auto testCandidate = [&](const Candidate& candidate, int thread, float bound,
+							 const std::atomic<float>* sharedError)
+	{
+		uint8_t*	lineColor = &myScratchColor(0, thread);
+		SearchCounters*	counters = &myCounters[thread];
+		float		curError;
+
+		memcpy(lineColor, prevColor, cells);
+		counters->candidates++;
+
+		if (dist)
+		{
+			ditherLineMatrix(candidate.index, dist, distStride, width, cellSize, palSize, dither,
+							 &curError, bound, colorInc, lineColor, sharedError, cellBound, counters);
+		}
+		else if (dither && bleed > 0)
+		{
+			// the error spreads along the line, so dither a copy
+			float*	scratch = myMemBackup(0, thread);
+
+			memcpy(scratch, curY, width*4 * sizeof(float));
+			ditherLine(candidate.index, y, false, width, height, cellSize, scratch, palSize,
+					   bleed, matrix, dither, &curError, bound, colorInc, lineColor, sharedError,
+					   0, width, counters);
+		}
+		else
+		{
+			scoreLine(candidate.index, y, width, height, cellSize, curY, palSize, dither,
+					  &curError, bound, colorInc, lineColor, sharedError, counters);
+		}
+
+		return curError;
+	};
+
+	// Lowest error wins, the lowest rank on a tie, so the order candidates
+	// are tried in only changes how soon the bound tightens.
+	auto testCandidates = [&](int numCandidates)
+	{
+		std::stable_sort(candidates, candidates + numCandidates,
+						 [](const Candidate& a, const Candidate& b) { return a.key < b.key; });
+
+		if (parallel)
+		{
+			std::atomic<float>	sharedError(*bestError);
+
+			myPool->parallelFor(numCandidates, [&](int i, int thread)
+			{
+				Candidate&	candidate = candidates[i];
+
+				float	curError = testCandidate(candidate, thread, HUGE_VAL, &sharedError);
+				candidate.error = curError;
+
+				// lower the bound for everyone else
+				float	cur = sharedError.load();
+				while (curError < cur && !sharedError.compare_exchange_weak(cur, curError))
+					;
+			});
+
+			for (int i=0; i<numCandidates; i++)
+			{
+				const Candidate&	candidate = candidates[i];
+
+				if (candidate.error < *bestError ||
+					(candidate.error == *bestError && candidate.rank < bestRank))
+				{
+					*bestError = candidate.error;
+					*bestB = candidate.index;
+					bestRank = candidate.rank;
+				}
+			}
+		}
+		else
+		{
+			for (int i=0; i<numCandidates; i++)
+			{
+				const Candidate&	candidate = candidates[i];
+
+				// a lower rank still wins on a tie
+				bool	first = candidate.rank < bestRank;
+				float	bound = first ? nextafterf(*bestError, HUGE_VAL) : *bestError;
+
+				float	curError = testCandidate(candidate, thread, bound, nullptr);
+
+				if (curError < *bestError || (curError == *bestError && first))
+				{
+					*bestError = curError;
+					*bestB = candidate.index;
+					bestRank = candidate.rank;
+				}
+			}
+		}
+	};
+
+	// start with best color from previous frame, then the most common runs
+	const uint8_t*	order;
+	const uint8_t*	place;
+	getSearchOrder(colorInc, order, place);
+
+	int		runs = (palSize + colorInc - 1) / colorInc;
+	int		prevB = (int)(myResultBK(0, y)[3]);
+	int		startRun = place[prevB] / colorInc;
+
+	// a run's count covers all of its entries, hues and their shades on the
+	// Atari palettes
+	int		runCount[256] = {};
+	for (int i=0; i<palSize; i++)
+		runCount[place[i] / colorInc] += histogram[i];
+
+	runCount[startRun % runs] = width;
+	histogram[prevB] = width;
+
+	int		numCandidates = 0;
+	for (int i=0; i<runs; i++)
+	{
+		Candidate&	candidate = candidates[numCandidates];
+		int			run = (startRun + i) % runs;
+
+		candidate.index = order[run * colorInc];
+		candidate.rank = numCandidates++;
+		candidate.key = (float)-runCount[run];
+	}
+
+	testCandidates(numCandidates);
+
+	// now redo rest of the run
+	int b2 = place[*bestB] & ~(colorInc-1);	// round down to nearest inc
+
+	int		firstRank = numCandidates;
+
+	numCandidates = 0;
+	for (int b=1; b<colorInc && b2 + b<palSize; b++)
+	{
+		Candidate&	candidate = candidates[numCandidates++];
+
+		candidate.index = order[b2 + b];
+		candidate.rank = firstRank + b;
+		candidate.key = (float)-histogram[candidate.index];
+	}
+
+	testCandidates(numCandidates);
+}
+
+void
+Colorizer::getSearchOrder(int colorInc, const uint8_t*& order, const uint8_t*& place) const
+{
+	// an exhaustive search goes in palette order, as it always has
+	if (colorInc > 1)
+	{
+		order = myPalOrder;
+		place = myPalPlace;
+	}
+	else
+	{
+		order = Identity.entries;
+		place = Identity.entries;
+	}
+}
+
+void
+Colorizer::setupThresholds(int matrix, int width)
+{
+	if (!isThresholdMatrix(matrix) || (matrix == myThresholdMatrix && width == myThresholds.getWidth()))
+		return;
+
+	// each made the first time it's wanted, the blue noise takes a moment
+	const std::vector<float>*	table;
+	int							size;
+
+	if (matrix == Matrix_Bayer)
+	{
+		static const std::vector<float>	bayer = makeBayer(8, 3);
+		table = &bayer;
+		size = 8;
+	}
+	else
+	{
+		static const std::vector<float>	blueNoise = makeBlueNoise(64);
+		table = &blueNoise;
+		size = 64;
+	}
+
+	myThresholds.setSize(width, size);
+
+	for (int y=0; y<size; y++)
+	{
+		for (int x=0; x<width; x++)
+			myThresholds(x, y) = (*table)[y * size + x % size];
+	}
+
+	myThresholdMatrix = matrix;
+}
+
+void
+Colorizer::setupStorage(int outputWidth, int outputHeight, int cellSize, int threads,
+	int distStride, bool fixedDist)
+{
+	// the previous frame's backgrounds start each line's search
+	if (myResultBK.setSize(1, outputHeight))
+		forgetBackgrounds();
+	if (myMemBackup.setSize(outputWidth, threads, MatrixGuard))
+		myMemBackup.zero();
+
+	// only the matrix search engine needs these
+	if (distStride)
+	{
+		if (fixedDist)
+		{
+			myLineDist.setSize(0, 0);
+			myLineDist16.setSize(distStride * outputWidth, threads);
+		}
+		else
+		{
+			myLineDist.setSize(distStride * outputWidth, threads);
+			myLineDist16.setSize(0, 0);
+		}
+		myCellBound.setSize(outputWidth / cellSize + 1, threads);
+	}
+	else
+	{
+		myLineDist.setSize(0, 0);
+		myLineDist16.setSize(0, 0);
+		myCellBound.setSize(0, 0);
+	}
+
+	outputWidth /= cellSize;
+	if (outputWidth < 1)
+		outputWidth = 1;
+
+	myResultGraph.setSize(outputWidth, outputHeight);
+	// the previous frame's colours start each cell's search
+	if (myResultColor.setSize(outputWidth, outputHeight))
+		myResultColor.zero();
+	myScratchColor.setSize(outputWidth, threads);
+	myCounters.resize(threads);
+}
+
+void
+Colorizer::storeResults(uint8_t *destMem, int cellSize)
+{
+	// streamed frames were stored as they went
+	if (!myMem.getData())
+		return;
+
+	Clock::time_point	start = Clock::now();
+
+	for (int y = 0; y<myResultGraph.getHeight(); y++)
+		storeLine(y, myMem(0, y), destMem, cellSize);
+
+	myStats.storeMs = elapsedMs(start);
+	myStoreMs = myStats.storeMs;
+}
+
+void
+Colorizer::storeLine(int y, const float* curY, uint8_t *destMem, int cellSize)
+{
+	int outputWidth = myResultGraph.getWidth();
+	int	bidx = (int)myResultBK(0, y)[3];
+
+	for (int x=0; x<outputWidth; x++)
+	{
+		const float* pixel = &curY[4 * x*cellSize];
+
+		// take next cellSize rgb bits for dither
+		uint8_t val = 0;
+
+		for (int i = 0; i < cellSize; i++, pixel +=4)
+		{
+			val <<= 1;
+
+			// only store non-backcolor in this array
+			if (uint8_t(pixel[3]) != bidx)
+				val |= 1;
+		}
+
+		if (destMem)
+		{
+			uint8_t* destPixel = &destMem[4 * cellSize * (y*outputWidth + x)];
+
+			pixel = &curY[4 * x*cellSize];
+
+			for (int i = 0; i < cellSize; i++, destPixel += 4, pixel +=4)
+			{
+				if (uint8_t(pixel[3]) != bidx)
+				{
+					destPixel[0] = uint8_t(pixel[2] * 255.0f);
+					destPixel[1] = uint8_t(pixel[1] * 255.0f);
+					destPixel[2] = uint8_t(pixel[0] * 255.0f);
+
+					// set alpha to solid
+					destPixel[3] = 255;
+				}
+				else
+				{
+					// turn off background
+
+					destPixel[0] = 0;
+					destPixel[1] = 0;
+					destPixel[2] = 0;
+					destPixel[3] = 0;
+				}
+			}
+		}
+
+		myResultGraph(x, y) = val;
+	}
+}
+
+int
+Colorizer::getPackedSize() const
+{
+	return myResultGraph.getHeight() * (2*myResultGraph.getWidth() + 1);
+}
+
+void
+Colorizer::packResults(uint8_t *dest) const
+{
+	int		cells = myResultGraph.getWidth();
+	int		lines = myResultGraph.getHeight();
+
+	uint8_t*	graph = dest;
+	uint8_t*	color = graph + lines * cells;
+	uint8_t*	bkcolor = color + lines * cells;
+
+	for (int i=0; i<lines; i++)
+	{
+		int y = lines - i - 1; // reverse
+
+		const uint8_t*	srcGraph = &myResultGraph(0, y);
+		const uint8_t*	srcColor = &myResultColor(0, y);
+
+		memcpy(graph, srcGraph, cells);
+		graph += cells;
+
+		// top 7 bits only
+		for (int x=0; x<cells; x++)
+			*color++ = srcColor[x] << 1;
+
+		*bkcolor++ = ((int)myResultBK(0, y)[3]) << 1;
+	}
+}
@@ -0,0 +1,286 @@
+/*
+
+   Colorize engine
+
+   Quantises an RGBA32F frame into cells of one foreground colour
+   over a per line background colour, independent of TouchDesigner.
+
+   Rows are stored bottom row first, as TouchDesigner textures are.
+
+*/
+
+#ifndef __COLORIZER__
+#define __COLORIZER__
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "Array2D.h"
+#include "Downsampler.h"
+#include "PaletteLookup.h"
+#include "Palettes.h"
+#include "ThreadPool.h"
+
+
+enum
+{
+	Matrix_FloydSteinberg = 0,
+	Matrix_JIN = 1,
+	Matrix_Atkinson = 2,
+	Matrix_Bayer = 3,				// ordered 8x8 thresholds, no error passed on
+	Matrix_BlueNoise = 4			// 64x64 blue noise thresholds, same
+};
+
+enum
+{
+	SearchEngine_Direct = 0,		// every candidate dithers a copy of the line
+	SearchEngine_Matrix = 1			// candidates scored from per line palette distances
+};
+
+enum
+{
+	Precision_Float = 0,
+	Precision_Fixed16 = 1			// matrix search distances in 16 bit fixed point
+};
+
+struct ColorizeParams
+{
+	int			palette = Palette_Atari2600NTSC;
+	int			cellSize = 8;
+	bool		dither = false;
+	float		bleed = 1.0f;
+	bool		bleedSearch = false;
+	int			matrix = Matrix_FloydSteinberg;
+	int			colorSearch = 2;		// 0 average, 1-4 coarse to exhaustive
+	int			threads = 1;			// worker threads, 0 for all cores
+	int			searchEngine = SearchEngine_Matrix;
+	int			precision = Precision_Float;
+	int			gridWidth = 0;			// area downsample to this size first, 0 keeps the input's
+	int			gridHeight = 0;
+	float		budgetMs = 0;			// time for the whole frame, input, search and storeResults, lines searched to fit, 0 for no limit
+};
+
+// Where the last frame's time went and how much searching it took. Line
+// stages add up over the threads running lines, so they can be more than
+// the frame took with several threads.
+struct ColorizeStats
+{
+	double		setupMs = 0;		// palette lookup, storage and input copy or downsample
+	double		searchMs = 0;		// background search
+	double		ditherMs = 0;		// final dither of each line with its background
+	double		storeMs = 0;		// storeResults
+	int			lines = 0;			// lines searched
+	int64_t		candidates = 0;		// background candidates scored
+	int64_t		cutoffs = 0;		// candidates stopped early by the best error
+	int64_t		lookups = 0;		// palette lookups
+	float		searchLevel = 0;	// mean colour search level of the lines, with a budget
+	int			lateLines = 0;		// dropped to level 0 to keep to the budget
+};
+
+// one thread's share of ColorizeStats, padded apart
+struct SearchCounters
+{
+	double		searchMs = 0;
+	double		ditherMs = 0;
+	int64_t		candidates = 0;
+	int64_t		cutoffs = 0;
+	int64_t		lookups = 0;
+	char		pad[24];
+};
+
+// background candidate of a line search
+struct Candidate
+{
+	int			index;			// palette entry
+	int			rank;			// place in the plain search order, settles ties
+	float		key;			// tried in increasing key order
+	float		error;
+};
+
+class Colorizer
+{
+public:
+	Colorizer();
+	~Colorizer();
+
+	// rebuilds the colour lookup when the palette changes
+	void				setPalette(int palette);
+
+	// works on a pool shared with other colorizers run one at a time from the
+	// same thread, instead of params.threads of its own, null to go back
+	void				setThreadPool(const std::shared_ptr<ThreadPool>& pool);
+
+	// quantise one width x height RGBA32F frame
+	void				execute(const ColorizeParams& params, const float* rgba, int width, int height);
+
+	// same, working on rgba itself instead of a copy, it has to stay
+	// valid until storeResults()
+	void				executeInPlace(const ColorizeParams& params, float* rgba, int width, int height);
+
+	// same, reading rgba a line at a time into a few rows of working memory
+	// and storing each line as it's done, so there's no storeResults() after.
+	// Lines go in order, only the background search uses the threads.
+	void				executeStreaming(const ColorizeParams& params, const float* rgba,
+							int width, int height, uint8_t *destMem = nullptr);
+
+	// fills the graph results, and optionally a getWidth() x getHeight() BGRA8 preview
+	void				storeResults(uint8_t *destMem, int cellSize);
+
+	// size the last frame was quantised at, after any downsampling
+	int					getWidth() const { return myWidth; }
+	int					getHeight() const { return myHeight; }
+
+	const Array2D<uint8_t>&		getResultGraph() const { return myResultGraph; }
+	const Array2D<uint8_t>&		getResultColor() const { return myResultColor; }
+	const Array2D<float[4]>&	getResultBK() const { return myResultBK; }
+
+	// results packed top line first: graph[lines][cells], then color[lines][cells]
+	// and bkcolor[lines] with colours in the top 7 bits
+	int					getPackedSize() const;
+	void				packResults(uint8_t *dest) const;
+
+	// of the last execute and storeResults
+	const ColorizeStats&		getStats() const { return myStats; }
+
+private:
+
+	// spentMs of the frame's budget already gone on the input
+	void				quantize(const ColorizeParams& params, int width, int height, double spentMs);
+
+	// row y being worked on, of myMem or the ring
+	float*				getWorkRow(int y);
+	void				loadRow(int y, int width);
+	void				storeLine(int y, const float *curY, uint8_t *destMem, int cellSize);
+
+	// the size to quantise at, true when the input has to be downsampled to it
+	bool				setupGrid(const ColorizeParams& params, int& width, int& height);
+
+    void                setupStorage(int outputWidth, int outputHeight, int cellSize, int threads,
+							int distStride, bool fixedDist);
+
+	// myThresholds for a threshold matrix
+	void				setupThresholds(int matrix, int width);
+
+    Array2D<float[4]>	myMem;
+    Array2D<float[4]>	myRows;				// ring of working rows when streaming
+    const float*		myStreamInput;		// frame being streamed, or null
+    uint8_t*			myStreamDest;		// its preview, or null
+    bool				myStreamScaled;		// through myDownsampler
+    Downsampler			myDownsampler;
+    int					myWidth;			// size last quantised at
+    int					myHeight;
+    Array2D<float[4]>	myMemBackup;		// one scratch line per thread, for bleed in the search
+    Array2D<uint8_t>	myResultGraph;
+    Array2D<uint8_t>	myResultColor;
+    Array2D<float[4]>	myResultBK;
+    Array2D<float[3]>	myFPal;
+    float				myPalPlanes[3][256];	// myFPal as r, g, b planes for the kernels
+    int16_t				myPalPlanes16[3][256];	// and as 8 bit levels for the fixed point kernels
+
+    unsigned char*		myLastPal;
+    int					myPalSize;
+    std::shared_ptr<const PaletteLookup>	myLookup;
+    uint8_t				myPalRemap[256];		// palette entry after lookupClosestInPalette
+    const uint8_t*		myPalOrder;				// palette entries in coarse to fine search order
+    const uint8_t*		myPalPlace;				// and where each is in it
+
+	// Coarse searches try the first entry of each aligned run of colorInc
+	// places in order, starting from the run of the previous frame's
+	// choice, then the rest of the best entry's run. The Atari palettes'
+	// runs are the shades of a hue, the others use the lookup's clusters.
+	void				getSearchOrder(int colorInc, const uint8_t*& order, const uint8_t*& place) const;
+
+    void				ditherLine(int bidx, int y, bool finalB, int width, int height, int cellSize,
+							float *curY, int palSize, float bleed, int matrix,
+							bool dither, float *curError, float bestError,
+							int colorInc, uint8_t *lineColor, const std::atomic<float> *sharedError,
+							int xStart, int xEnd, SearchCounters *counters);
+
+	typedef void		(Colorizer::*DitherLineFunc)(int bidx, int y, int width, int height,
+							int cellSize, float *curY, int palSize, float bleed, float *curError,
+							float bestError, int colorInc, uint8_t *lineColor,
+							const std::atomic<float> *sharedError, int xStart, int xEnd,
+							SearchCounters *counters);
+
+	// ditherLine with the error matrix, dither, search, final pass and
+	// cell size fixed, a CellSize of 0 takes cellSize
+	template <int Matrix, bool Dither, bool Search, bool Final, int CellSize>
+	void				ditherLineT(int bidx, int y, int width, int height, int cellSize,
+							float *curY, int palSize, float bleed, float *curError, float bestError,
+							int colorInc, uint8_t *lineColor, const std::atomic<float> *sharedError,
+							int xStart, int xEnd, SearchCounters *counters);
+
+	template <int Matrix, bool Dither>
+	static DitherLineFunc	pickDitherLine(bool finalB, bool search, int cellSize);
+
+	// ditherLine's search pass without bleed, only reading the line
+	void				scoreLine(int bidx, int y, int width, int height, int cellSize,
+							const float *curY, int palSize, bool dither, float *curError,
+							float bestError, int colorInc, uint8_t *lineColor,
+							const std::atomic<float> *sharedError, SearchCounters *counters);
+
+	// ditherLine's search pass without bleed, from the line's palette distances.
+	// cellBound, when given, is the least error left from each cell on; a
+	// candidate that can't beat the bound with it stops with HUGE_VAL.
+	// Dist is float, or uint16_t for the fixed point distances.
+	template <typename Dist>
+	void				ditherLineMatrix(int bidx, const Dist *dist, int distStride, int width,
+							int cellSize, int palSize, bool dither, float *curError, float bestError,
+							int colorInc, uint8_t *lineColor, const std::atomic<float> *sharedError,
+							const float *cellBound, SearchCounters *counters);
+
+	// best background of one line, the candidates spread over the thread
+	// pool when parallel, and scored with ditherLineMatrix when dist is given
+	template <typename Dist>
+	void				searchBackground(int y, int thread, const float *curY, int width, int height,
+							int cellSize, int palSize, float bleed, int matrix, bool dither, int colorInc,
+							const Dist *dist, int distStride, bool parallel, int *bestB, float *bestError);
+
+	// ColorizeParams::budgetMs: each line's colour search level, 0 keeping
+	// the previous frame's background, planned from what lines cost at each
+	// level before, with the lines that came out worst getting the time left
+	static const int	NumSearchLevels = 5;
+
+	// the previous frame's backgrounds can't be kept, none or another palette's
+	void				forgetBackgrounds();
+
+	// 1 for a line without a background to keep
+	int					getLowestLevel(int y) const;
+
+	void				forgetCosts();
+	float				estimateLineCost(int y, int level) const;
+	float				estimateLevelCost(int level) const;
+	void				updateLineCost(int y, int level, float ms);
+	void				planSearch(int height, int maxLevel, double budgetMs);
+
+	// lines without a background search, each chasing the one above
+	void				finishFrameWavefront(int width, int height, int cellSize, int palSize, float bleed,
+							int matrix, bool dither);
+
+	std::shared_ptr<ThreadPool>	myPool;
+	bool				mySharedPool;		// set by setThreadPool()
+	Array2D<uint8_t>	myScratchColor;		// one line of cell colours per thread
+	Array2D<float>		myLineDist;			// one line of palette distances per thread
+	Array2D<uint16_t>	myLineDist16;		// same, in fixed point
+	Array2D<float>		myCellBound;		// least error left from each cell, per thread
+	Array2D<float>		myThresholds;		// threshold matrix rows tiled across the frame
+	int					myThresholdMatrix;	// they were made for
+	std::vector<SearchCounters>	myCounters;	// per thread
+
+	std::vector<float>	myLineCost;			// ms for each line at each search level, 0 until run
+	float				myLevelCost[NumSearchLevels];	// ms for an average line at each level
+	float				myFrameMiss;		// mean ms frames took over their lines' estimates
+	float				myFrameMissSq;		// and its mean square
+	std::vector<float>	myLineError;		// each line's error when last searched, -1 for none
+	std::vector<uint8_t>	myLineLevel;	// planned search levels, then the levels run
+	std::vector<int>	myLineOrder;		// lines worst first
+
+	ColorizeStats		myStats;
+	double				myStoreMs;			// last storeResults(), charged to the next budget
+
+};
+
+#endif
@@ -0,0 +1,96 @@
+/*
+
+   Area downsampler for RGBA32F frames
+
+*/
+
+#include "Downsampler.h"
+#include "ColorKernels.h"
+
+#include <math.h>
+#include <string.h>
+
+
+Downsampler::Downsampler()
+{
+	mySrcWidth = mySrcHeight = 0;
+	myDstWidth = myDstHeight = 0;
+}
+
+void
+Downsampler::setSize(int srcWidth, int srcHeight, int dstWidth, int dstHeight)
+{
+	if (srcWidth == mySrcWidth && srcHeight == mySrcHeight &&
+		dstWidth == myDstWidth && dstHeight == myDstHeight)
+		return;
+
+	mySrcWidth = srcWidth;
+	mySrcHeight = srcHeight;
+	myDstWidth = dstWidth;
+	myDstHeight = dstHeight;
+
+	makeTaps(srcWidth, dstWidth, myTapsX);
+	makeTaps(srcHeight, dstHeight, myTapsY);
+
+	myRow.resize(4 * srcWidth);
+}
+
+void
+Downsampler::makeTaps(int srcSize, int dstSize, Taps& taps)
+{
+	taps.first.resize(dstSize);
+	taps.count.resize(dstSize);
+	taps.offset.resize(dstSize);
+	taps.weights.clear();
+
+	double	scale = (double)srcSize / dstSize;
+
+	for (int i=0; i<dstSize; i++)
+	{
+		double	start = i * scale;
+		double	end = (i + 1) * scale;
+
+		int		first = (int)floor(start);
+		int		last = (int)ceil(end) - 1;
+
+		if (last >= srcSize)
+			last = srcSize - 1;
+		if (last < first)
+			last = first;
+
+		taps.first[i] = first;
+		taps.count[i] = last - first + 1;
+		taps.offset[i] = (int)taps.weights.size();
+
+		// how much of each source pixel is covered, adding up to 1
+		double	total = 0.0;
+
+		for (int j=first; j<=last; j++)
+		{
+			double	cover = (j + 1 < end ? j + 1 : end) - (j > start ? j : start);
+			total += cover;
+		}
+
+		for (int j=first; j<=last; j++)
+		{
+			double	cover = (j + 1 < end ? j + 1 : end) - (j > start ? j : start);
+			taps.weights.push_back((float)(cover / total));
+		}
+	}
+}
+
+void
+Downsampler::filterLine(const float *src, int y, float *dst)
+{
+	int		first = myTapsY.first[y];
+	int		count = myTapsY.count[y];
+	const float*	weights = &myTapsY.weights[myTapsY.offset[y]];
+
+	memset(myRow.data(), 0, myRow.size() * sizeof(float));
+
+	for (int j=0; j<count; j++)
+		scaleAddRow(myRow.data(), &src[4 * (size_t)(first + j) * mySrcWidth], 4 * mySrcWidth, weights[j]);
+
+	filterRow(myRow.data(), myDstWidth, myTapsX.first.data(), myTapsX.count.data(),
+			  myTapsX.weights.data(), dst);
+}
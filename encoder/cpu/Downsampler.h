@@ -0,0 +1,57 @@
+/*
+
+   Area downsampler for RGBA32F frames
+
+   Each output pixel is the average of the source area it covers, partly
+   covered source pixels counting by how much of them falls inside. Lines
+   are filtered down the frame first, a whole source row at a time, then
+   along the line, so only one row of scratch is needed and a line can be
+   made as it's wanted.
+
+*/
+
+#ifndef __DOWNSAMPLER__
+#define __DOWNSAMPLER__
+
+#include <vector>
+
+
+class Downsampler
+{
+public:
+	Downsampler();
+
+	// weights from srcWidth x srcHeight down to dstWidth x dstHeight
+	void				setSize(int srcWidth, int srcHeight, int dstWidth, int dstHeight);
+
+	int					getSrcWidth() const { return mySrcWidth; }
+	int					getSrcHeight() const { return mySrcHeight; }
+
+	// output line y of src, its rows srcWidth pixels apart, into dst
+	void				filterLine(const float *src, int y, float *dst);
+
+private:
+
+	// the source pixels of each output pixel along one axis
+	struct Taps
+	{
+		std::vector<int>	first;
+		std::vector<int>	count;
+		std::vector<int>	offset;		// of the first weight
+		std::vector<float>	weights;
+	};
+
+	static void			makeTaps(int srcSize, int dstSize, Taps& taps);
+
+	int					mySrcWidth;
+	int					mySrcHeight;
+	int					myDstWidth;
+	int					myDstHeight;
+
+	Taps				myTapsX;
+	Taps				myTapsY;
+
+	std::vector<float>	myRow;		// source row filtered down the frame
+};
+
+#endif
@@ -0,0 +1,327 @@
+/*
+
+   MovieCart .mvc writer
+
+*/
+
+#include "MVCWriter.h"
+#include "Colorizer.h"
+#include "Palettes.h"
+
+#include <string.h>
+
+
+// 8 pixel wide digits and ':', 9 lines high
+static const uint8_t	TimecodeFont[11][9] =
+{
+	{ 0x3c, 0x42, 0x42, 0x46, 0x5a, 0x62, 0x42, 0x42, 0x3c },
+	{ 0x18, 0x28, 0x48, 0x08, 0x08, 0x08, 0x08, 0x08, 0x7e },
+	{ 0x3c, 0x42, 0x02, 0x02, 0x0c, 0x30, 0x40, 0x40, 0x7e },
+	{ 0x3c, 0x42, 0x02, 0x02, 0x1c, 0x02, 0x02, 0x42, 0x3c },
+	{ 0x04, 0x0c, 0x14, 0x24, 0x44, 0x7e, 0x04, 0x04, 0x04 },
+	{ 0x7e, 0x40, 0x40, 0x7c, 0x02, 0x02, 0x02, 0x42, 0x3c },
+	{ 0x1c, 0x20, 0x40, 0x40, 0x7c, 0x42, 0x42, 0x42, 0x3c },
+	{ 0x7e, 0x02, 0x04, 0x04, 0x08, 0x08, 0x10, 0x10, 0x10 },
+	{ 0x3c, 0x42, 0x42, 0x42, 0x3c, 0x42, 0x42, 0x42, 0x3c },
+	{ 0x3c, 0x42, 0x42, 0x42, 0x3e, 0x02, 0x02, 0x04, 0x38 },
+	{ 0x00, 0x00, 0x18, 0x18, 0x00, 0x00, 0x18, 0x18, 0x00 },
+};
+
+static const int	TimecodeColon = 10;
+
+// audio byte of silence, mid level like the encoded examples
+static const uint8_t	AudioSilence = 8;
+
+static inline uint8_t
+toBCD(int v)
+{
+	return (uint8_t)(((v / 10) << 4) | (v % 10));
+}
+
+
+MVCWriter::MVCWriter()
+{
+	myOutput = nullptr;
+	myBatchFields = 0;
+	myNumFields = 0;
+	myFill = 0;
+	myNext = 0;
+	myQueued = 0;
+	myQuit = false;
+	myFailed = false;
+}
+
+MVCWriter::~MVCWriter()
+{
+	close();
+}
+
+MVCFormat
+MVCWriter::getFormat(int palette, int visible)
+{
+	MVCFormat	format;
+
+	if (palette == Palette_Atari2600PAL || palette == Palette_Atari2600SECAM)
+		format.rate = 50;
+
+	format.visible = visible;
+	return format;
+}
+
+bool
+MVCWriter::getStandard(const char *name, int& palette, MVCFormat& format)
+{
+	if (!strcmp(name, "ntsc"))
+		palette = Palette_Atari2600NTSC;
+	else if (!strcmp(name, "pal") || !strcmp(name, "pal60"))
+		palette = Palette_Atari2600PAL;
+	else if (!strcmp(name, "secam"))
+		palette = Palette_Atari2600SECAM;
+	else
+		return false;
+
+	bool	lines50 = strcmp(name, "ntsc") && strcmp(name, "pal60");
+
+	format = getFormat(palette, lines50 ? 242 : 192);
+	format.rate = lines50 ? 50 : 60;
+	return true;
+}
+
+bool
+MVCWriter::open(FILE *output, const MVCFormat& format, int batchFields)
+{
+	close();
+
+	// header, lines and the timecode have to fit the field, and the
+	// line counts their bytes
+	int		used = 14 + format.getTotalLines() + 11 * format.visible + 5 * TimecodeLines;
+
+	if (!output || format.visible < TimecodeLines || format.visible > 255 || used > FieldSize ||
+		format.vsync < 0 || format.vsync > 255 || format.vblank < 0 || format.vblank > 255 ||
+		format.overscan < 0 || format.overscan > 255 || format.rate < 1 || format.rate > 100)
+		return false;
+
+	myOutput = output;
+	myFormat = format;
+	myBatchFields = batchFields < 2 ? 2 : (batchFields & ~1);
+	myNumFields = 0;
+
+	for (int i=0; i<NumBatches; i++)
+	{
+		myBatches[i].data.assign(myBatchFields * FieldSize, 0);
+		myBatches[i].fields = 0;
+	}
+
+	myFill = 0;
+	myNext = 0;
+	myQueued = 0;
+	myQuit = false;
+	myFailed = false;
+
+	setvbuf(myOutput, nullptr, _IONBF, 0);
+
+	myThread = std::thread(&MVCWriter::writerLoop, this);
+	return true;
+}
+
+bool
+MVCWriter::writeFrame(const Colorizer& colorizer, const uint8_t *audio0, const uint8_t *audio1)
+{
+	if (!myOutput)
+		return false;
+
+	const Array2D<uint8_t>&	resultGraph = colorizer.getResultGraph();
+
+	if (resultGraph.getWidth() != 10 || resultGraph.getHeight() != myFormat.visible)
+		return false;
+
+	myPacked.resize(colorizer.getPackedSize());
+	colorizer.packResults(myPacked.data());
+
+	{
+		std::lock_guard<std::mutex>	lock(myMutex);
+		if (myFailed)
+			return false;
+	}
+
+	Batch&	batch = myBatches[myFill];
+
+	for (int f=0; f<2; f++)
+	{
+		uint8_t*	dst = &batch.data[batch.fields * FieldSize];
+
+		buildField(dst, myPacked.data(), f, f ? audio1 : audio0);
+		batch.fields++;
+		myNumFields++;
+	}
+
+	if (batch.fields == myBatchFields)
+		submitBatch();
+
+	return true;
+}
+
+bool
+MVCWriter::close()
+{
+	if (!myOutput)
+		return true;
+
+	if (myBatches[myFill].fields)
+		submitBatch();
+
+	{
+		std::lock_guard<std::mutex>	lock(myMutex);
+		myQuit = true;
+	}
+	myCond.notify_all();
+
+	myThread.join();
+
+	if (fflush(myOutput))
+		myFailed = true;
+
+	myOutput = nullptr;
+
+	for (int i=0; i<NumBatches; i++)
+		std::vector<uint8_t>().swap(myBatches[i].data);
+
+	return !myFailed;
+}
+
+void
+MVCWriter::buildField(uint8_t *dst, const uint8_t *packed, int field, const uint8_t *audio)
+{
+	const int	visible = myFormat.visible;
+	const int	totalLines = myFormat.getTotalLines();
+
+	const uint8_t*	srcGraph = packed;
+	const uint8_t*	srcColor = srcGraph + 10 * visible;
+	const uint8_t*	srcBK = srcColor + 10 * visible;
+
+	// header, see FrameFormat in firmware/frame.c
+
+	int		second = myNumFields / myFormat.rate;
+
+	dst[0] = 'M';
+	dst[1] = 'V';
+	dst[2] = 'C';
+	dst[3] = 0;
+	dst[4] = 0x80;
+	dst[5] = toBCD((second / 3600) % 100);
+	dst[6] = toBCD((second / 60) % 60);
+	dst[7] = toBCD(second % 60);
+	dst[8] = toBCD(myNumFields % myFormat.rate);
+	dst[9] = (uint8_t)myFormat.vsync;
+	dst[10] = (uint8_t)myFormat.vblank;
+	dst[11] = (uint8_t)myFormat.overscan;
+	dst[12] = (uint8_t)visible;
+	dst[13] = (uint8_t)myFormat.rate;
+
+	uint8_t*	dstAudio = dst + 14;
+	uint8_t*	dstGraph = dstAudio + totalLines;
+	uint8_t*	dstColor = dstGraph + 5 * visible;
+	uint8_t*	dstBK = dstColor + 5 * visible;
+	uint8_t*	dstTimecode = dstBK + visible;
+	uint8_t*	end = dstTimecode + 5 * TimecodeLines;
+
+	if (audio)
+		memcpy(dstAudio, audio, totalLines);
+	else
+		memset(dstAudio, AudioSilence, totalLines);
+
+	// this field's half of each line's cells
+
+	for (int y=0; y<visible; y++)
+	{
+		int		first = (y + field) & 1;
+
+		for (int i=0; i<5; i++)
+		{
+			dstGraph[5*y + i] = srcGraph[10*y + 2*i + first];
+			dstColor[5*y + i] = srcColor[10*y + 2*i + first];
+		}
+	}
+
+	memcpy(dstBK, srcBK, visible);
+
+	drawTimecode(dstTimecode, field);
+
+	memset(end, 0, dst + FieldSize - end);
+}
+
+// h:mm:ss:ff across the 10 cells, the second field a line lower
+
+void
+MVCWriter::drawTimecode(uint8_t *dst, int field)
+{
+	int		second = myNumFields / myFormat.rate;
+	int		frame = myNumFields % myFormat.rate;
+
+	int		text[10] =
+	{
+		(second / 3600) % 10, TimecodeColon,
+		(second / 600) % 6, (second / 60) % 10, TimecodeColon,
+		(second / 10) % 6, second % 10, TimecodeColon,
+		frame / 10, frame % 10
+	};
+
+	memset(dst, 0, 5 * TimecodeLines);
+
+	for (int y=field; y<field + 9; y++)
+	{
+		int		first = y & 1;
+
+		for (int i=0; i<5; i++)
+			dst[5*y + i] = TimecodeFont[text[2*i + first]][y - field];
+	}
+}
+
+void
+MVCWriter::submitBatch()
+{
+	std::unique_lock<std::mutex>	lock(myMutex);
+
+	myQueued++;
+	myCond.notify_all();
+
+	// the next batch to fill has to be written out already
+	myCond.wait(lock, [this] { return myQueued < NumBatches; });
+
+	myFill = (myFill + 1) % NumBatches;
+	myBatches[myFill].fields = 0;
+}
+
+void
+MVCWriter::writerLoop()
+{
+	for (;;)
+	{
+		int		index;
+
+		{
+			std::unique_lock<std::mutex>	lock(myMutex);
+			myCond.wait(lock, [this] { return myQueued > 0 || myQuit; });
+
+			if (!myQueued)
+				return;
+
+			index = myNext;
+		}
+
+		const Batch&	batch = myBatches[index];
+		size_t			size = (size_t)batch.fields * FieldSize;
+		bool			ok = fwrite(batch.data.data(), 1, size, myOutput) == size;
+
+		{
+			std::lock_guard<std::mutex>	lock(myMutex);
+
+			if (!ok)
+				myFailed = true;
+
+			myNext = (myNext + 1) % NumBatches;
+			myQueued--;
+		}
+		myCond.notify_all();
+	}
+}
@@ -0,0 +1,117 @@
+/*
+
+   MovieCart .mvc writer
+
+   Each colorized picture of 10 cells per line becomes two 8x512 byte
+   fields in the FrameFormat layout of firmware/frame.c:
+
+	header		'M', 'V', 'C', 0, format, timecode[4], vsync, vblank,
+				overscan, visible, rate
+	audio[vsync + vblank + overscan + visible]
+	graph[5 * visible]
+	color[5 * visible]
+	bkcolor[visible]
+	timecode[5 * 12]	bitmap shown by the cart's on screen display
+	padding
+
+   Line y of a field holds the 5 cells whose position c has (c + y + field)
+   even, the two fields share the background colours. The timecode is
+   hour, minute, second and field in bcd, counting rate fields a second.
+
+   Fields are gathered into batches that a writer thread hands to the
+   file in single writes, so the encoder never waits on the disk unless
+   every batch is still queued.
+
+*/
+
+#ifndef __MVCWRITER__
+#define __MVCWRITER__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class Colorizer;
+
+
+struct MVCFormat
+{
+	int			vsync = 3;
+	int			vblank = 37;
+	int			overscan = 30;
+	int			visible = 192;
+	int			rate = 60;			// fields per second
+
+	int			getTotalLines() const { return vsync + vblank + overscan + visible; }
+};
+
+class MVCWriter
+{
+public:
+	static const int	FieldSize = 8 * 512;
+	static const int	TimecodeLines = 12;
+
+	MVCWriter();
+	~MVCWriter();
+
+	// NTSC or PAL timing to go with a palette
+	static MVCFormat	getFormat(int palette, int visible);
+
+	// palette and format of the variants titles are released in: "ntsc",
+	// "pal" (242 lines at 50Hz), "pal60" (PAL colours with NTSC timing) and
+	// "secam", false for any other name
+	static bool			getStandard(const char *name, int& palette, MVCFormat& format);
+
+	// output stays the caller's to close, and is switched to unbuffered so
+	// each batch is one write
+	bool				open(FILE *output, const MVCFormat& format, int batchFields = 64);
+
+	// the colorizer's last results as the next two fields, audio is
+	// getTotalLines() 4 bit samples per field, or null for silence
+	bool				writeFrame(const Colorizer& colorizer,
+							const uint8_t *audio0 = nullptr, const uint8_t *audio1 = nullptr);
+
+	// flushes the last batch and waits for the writer, false if any write failed
+	bool				close();
+
+	int					getNumFields() const { return myNumFields; }
+
+private:
+
+	struct Batch
+	{
+		std::vector<uint8_t>	data;
+		int						fields;
+	};
+
+	void				buildField(uint8_t *dst, const uint8_t *packed, int field, const uint8_t *audio);
+	void				drawTimecode(uint8_t *dst, int field);
+
+	void				submitBatch();
+	void				writerLoop();
+
+	FILE*				myOutput;
+	MVCFormat			myFormat;
+	int					myBatchFields;
+	int					myNumFields;		// written so far, drives the timecode
+
+	std::vector<uint8_t>	myPacked;
+
+	static const int	NumBatches = 3;
+	Batch				myBatches[NumBatches];
+	int					myFill;				// batch being filled
+	int					myNext;				// next batch for the writer
+	int					myQueued;			// full batches not written yet
+	bool				myQuit;
+	bool				myFailed;
+
+	std::thread			myThread;
+	std::mutex			myMutex;
+	std::condition_variable	myCond;
+};
+
+#endif
@@ -0,0 +1,375 @@
+/*
+
+   Nearest palette entry for 8 bit rgb colours
+
+*/
+
+#include "PaletteLookup.h"
+#include "ColorKernels.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <thread>
+
+
+PaletteLookup::PaletteLookup()
+{
+	memset(myGrid, 0, sizeof(myGrid));
+	memset(myPal, 0, sizeof(myPal));
+	myPalSize = 0;
+	memset(myClusterOrder, 0, sizeof(myClusterOrder));
+	memset(myClusterPlace, 0, sizeof(myClusterPlace));
+
+	for (int i=0; i<256; i++)
+		myLevels[i] = i / 255.0f;
+}
+
+uint8_t
+PaletteLookup::nearest(int r, int g, int b, const uint8_t* list, int count) const
+{
+	// same colour values as a full 256^3 table would use
+	float	color[3] = { myLevels[r], myLevels[g], myLevels[b] };
+
+	int		best = list[0];
+	float	bestDist = HUGE_VAL;
+
+	// lists are padded to a multiple of 4 with their last entry, and
+	// written so the compiler can select without branching
+	for (int i=0; i<count; i+=4)
+	{
+		float	d[4];
+		for (int j=0; j<4; j++)
+			d[j] = colorDist(color, myPal[list[i+j]]);
+
+		for (int j=0; j<4; j++)
+		{
+			bool	closer = d[j] < bestDist;
+			best = closer ? list[i+j] : best;
+			bestDist = closer ? d[j] : bestDist;
+		}
+	}
+
+	return best;
+}
+
+void
+PaletteLookup::build(const float (*pal)[3], int palSize)
+{
+	if (palSize > 256)
+		palSize = 256;
+	if (palSize < 1)
+		palSize = 1;
+
+	memset(myPal, 0, sizeof(myPal));
+	memcpy(myPal, pal, palSize * sizeof(myPal[0]));
+	myPalSize = palSize;
+
+	myLists.clear();
+
+	// closest and furthest distance of each entry to each bucket, per axis
+	const int	cellWidth = 256 / GridSize;
+	std::vector<float>	nearAxis(3 * GridSize * 256);
+	std::vector<float>	farAxis(3 * GridSize * 256);
+
+	auto axis = [](std::vector<float>& a, int c, int i, int p) -> float&
+	{
+		return a[(c * GridSize + i) * 256 + p];
+	};
+
+	for (int c=0; c<3; c++)
+	{
+		for (int i=0; i<GridSize; i++)
+		{
+			float	lo = (i * cellWidth) / 255.0f;
+			float	hi = (i * cellWidth + cellWidth - 1) / 255.0f;
+
+			for (int p=0; p<palSize; p++)
+			{
+				float	v = myPal[p][c];
+				float	dNear = v < lo ? lo - v : (v > hi ? v - hi : 0.0f);
+				float	dFar = v - lo > hi - v ? v - lo : hi - v;
+
+				axis(nearAxis, c, i, p) = dNear * dNear * colorScales[c];
+				axis(farAxis, c, i, p) = dFar * dFar * colorScales[c];
+			}
+		}
+	}
+
+	float		palPlanes[3][256];
+
+	for (int c=0; c<3; c++)
+	{
+		for (int p=0; p<256; p++)
+			palPlanes[c][p] = myPal[p][c];
+	}
+
+	// one red slab of buckets, list offsets relative to the slab's own lists
+	auto buildSlab = [&](int ri, std::vector<uint8_t>& lists)
+	{
+		const int	bucketColors = cellWidth * cellWidth * cellWidth;
+
+		float		nearDist[256];
+		uint8_t		list[256];
+		float		colors[3][bucketColors];
+		uint8_t		nearest[bucketColors];
+
+		for (int gi=0; gi<GridSize; gi++)
+		{
+			for (int bi=0; bi<GridSize; bi++)
+			{
+				// no colour in the bucket is further than this from its nearest entry
+				float	bestFar = HUGE_VAL;
+
+				for (int p=0; p<palSize; p++)
+				{
+					nearDist[p] = axis(nearAxis, 0, ri, p) + axis(nearAxis, 1, gi, p) + axis(nearAxis, 2, bi, p);
+
+					float	farDist = axis(farAxis, 0, ri, p) + axis(farAxis, 1, gi, p) + axis(farAxis, 2, bi, p);
+					if (farDist < bestFar)
+						bestFar = farDist;
+				}
+
+				// allow for rounding, an extra entry only costs a compare
+				float	limit = bestFar * 1.0001f + 1e-6f;
+				int		count = 0;
+
+				for (int p=0; p<palSize; p++)
+				{
+					if (nearDist[p] <= limit)
+						list[count++] = p;
+				}
+
+				// the box bounds are loose, so search every colour in the
+				// bucket and keep only the entries that actually win
+				if (count > 1)
+				{
+					int		i = 0;
+
+					for (int r=0; r<cellWidth; r++)
+					{
+						for (int g=0; g<cellWidth; g++)
+						{
+							for (int b=0; b<cellWidth; b++, i++)
+							{
+								colors[0][i] = myLevels[ri * cellWidth + r];
+								colors[1][i] = myLevels[gi * cellWidth + g];
+								colors[2][i] = myLevels[bi * cellWidth + b];
+							}
+						}
+					}
+
+					nearestColors(colors[0], colors[1], colors[2], bucketColors, palPlanes,
+								  list, count, nearest);
+
+					bool	wins[256] = { false };
+					for (i=0; i<bucketColors; i++)
+						wins[nearest[i]] = true;
+
+					int		winners = 0;
+					for (i=0; i<count; i++)
+					{
+						if (wins[list[i]])
+							list[winners++] = list[i];
+					}
+
+					count = winners;
+				}
+
+				uint32_t&	bucket = myGrid[(ri << (2*GridBits)) | (gi << GridBits) | bi];
+
+				if (count == 1)
+				{
+					bucket = list[0];
+				}
+				else
+				{
+					bucket = ListFlag | ((uint32_t)lists.size() << 8) | (count - 1);
+					lists.insert(lists.end(), list, list + count);
+
+					for (int padded = count; padded & 3; padded++)
+						lists.push_back(list[count - 1]);
+				}
+			}
+		}
+	};
+
+	// slabs are independent, spread them over a few threads
+	std::vector<std::vector<uint8_t>>	slabLists(GridSize);
+
+	int		numThreads = std::thread::hardware_concurrency();
+	if (numThreads > 8)
+		numThreads = 8;
+
+	std::vector<std::thread>	threads;
+	for (int t=1; t<numThreads; t++)
+	{
+		threads.push_back(std::thread([&, t]()
+		{
+			for (int ri=t; ri<GridSize; ri+=numThreads)
+				buildSlab(ri, slabLists[ri]);
+		}));
+	}
+
+	for (int ri=0; ri<GridSize; ri+=(numThreads > 1 ? numThreads : 1))
+		buildSlab(ri, slabLists[ri]);
+
+	for (auto& thread : threads)
+		thread.join();
+
+	// join the slabs' lists in order
+	size_t	total = 0;
+	for (int ri=0; ri<GridSize; ri++)
+		total += slabLists[ri].size();
+	myLists.reserve(total);
+
+	for (int ri=0; ri<GridSize; ri++)
+	{
+		uint32_t	base = (uint32_t)myLists.size() << 8;
+		uint32_t*	bucket = &myGrid[ri << (2*GridBits)];
+
+		for (int i=0; i<GridSize*GridSize; i++)
+		{
+			if (bucket[i] & ListFlag)
+				bucket[i] += base;
+		}
+
+		myLists.insert(myLists.end(), slabLists[ri].begin(), slabLists[ri].end());
+	}
+
+	buildClusters();
+}
+
+void
+PaletteLookup::buildClusters()
+{
+	memset(myClusterOrder, 0, sizeof(myClusterOrder));
+	memset(myClusterPlace, 0, sizeof(myClusterPlace));
+
+	for (int i=0; i<myPalSize; i++)
+		myClusterOrder[i] = (uint8_t)i;
+
+	orderCluster(myClusterOrder, myPalSize, nearestToMean(myClusterOrder, myPalSize));
+
+	for (int i=0; i<myPalSize; i++)
+		myClusterPlace[myClusterOrder[i]] = (uint8_t)i;
+}
+
+// Splits a cluster in two along its widest channel, the first part a
+// power of two entries so the runs stay aligned. The part with the lead
+// goes first, the other is led by its entry nearest its mean.
+
+void
+PaletteLookup::orderCluster(uint8_t* entries, int count, int lead)
+{
+	if (count < 2)
+		return;
+
+	int		axis = 0;
+	float	widest = -1.0f;
+
+	for (int c=0; c<3; c++)
+	{
+		float	lo = HUGE_VAL;
+		float	hi = -HUGE_VAL;
+
+		for (int i=0; i<count; i++)
+		{
+			float	v = myPal[entries[i]][c];
+			lo = v < lo ? v : lo;
+			hi = v > hi ? v : hi;
+		}
+
+		float	width = (hi - lo) * (hi - lo) * colorScales[c];
+		if (width > widest)
+		{
+			widest = width;
+			axis = c;
+		}
+	}
+
+	std::stable_sort(entries, entries + count,
+		[&](uint8_t a, uint8_t b) { return myPal[a][axis] < myPal[b][axis]; });
+
+	int		first = 1;
+	while (first * 2 < count)
+		first *= 2;
+
+	// the lowest or highest entries along the axis, whichever has the lead
+	int		leadAt = (int)(std::find(entries, entries + count, (uint8_t)lead) - entries);
+
+	if (leadAt >= first)
+		std::rotate(entries, entries + count - first, entries + count);
+
+	orderCluster(entries, first, lead);
+	orderCluster(entries + first, count - first, nearestToMean(entries + first, count - first));
+}
+
+int
+PaletteLookup::nearestToMean(const uint8_t* entries, int count) const
+{
+	float	mean[3] = { 0.0f, 0.0f, 0.0f };
+
+	for (int i=0; i<count; i++)
+	{
+		for (int c=0; c<3; c++)
+			mean[c] += myPal[entries[i]][c];
+	}
+
+	for (int c=0; c<3; c++)
+		mean[c] /= count;
+
+	int		best = entries[0];
+	float	bestDist = HUGE_VAL;
+
+	for (int i=0; i<count; i++)
+	{
+		float	d = colorDist(mean, myPal[entries[i]]);
+		if (d < bestDist)
+		{
+			bestDist = d;
+			best = entries[i];
+		}
+	}
+
+	return best;
+}
+
+size_t
+PaletteLookup::getMemorySize() const
+{
+	return sizeof(*this) + myLists.capacity();
+}
+
+std::shared_ptr<const PaletteLookup>
+PaletteLookup::get(const float (*pal)[3], int palSize)
+{
+	static std::mutex	cacheMutex;
+	static std::map<uint64_t, std::weak_ptr<const PaletteLookup>>	cache;
+
+	// FNV-1a of the palette
+	uint64_t		key = 14695981039346656037ull ^ (uint64_t)palSize;
+	const uint8_t*	bytes = (const uint8_t*)pal;
+
+	for (size_t i=0; i<palSize * sizeof(pal[0]); i++)
+		key = (key ^ bytes[i]) * 1099511628211ull;
+
+	std::lock_guard<std::mutex>	lock(cacheMutex);
+
+	std::shared_ptr<const PaletteLookup>	lookup = cache[key].lock();
+
+	if (lookup && lookup->myPalSize == palSize &&
+		!memcmp(lookup->myPal, pal, palSize * sizeof(pal[0])))
+		return lookup;
+
+	PaletteLookup*	built = new PaletteLookup;
+	built->build(pal, palSize);
+
+	lookup.reset(built);
+	cache[key] = lookup;
+
+	return lookup;
+}
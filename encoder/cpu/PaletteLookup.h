@@ -0,0 +1,82 @@
+/*
+
+   Nearest palette entry for 8 bit rgb colours
+
+   The rgb cube is split into 32x32x32 buckets of 8x8x8 colours. A bucket
+   that only one palette entry can be nearest to holds that entry, the
+   others hold the short list of entries that could be, in palette order.
+   Ties go to the lowest palette index.
+
+   Lookups are read only, one per palette is shared between instances.
+   They also hold a clustering of the palette for coarse to fine searches.
+
+*/
+
+#ifndef __PALETTELOOKUP__
+#define __PALETTELOOKUP__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+
+class PaletteLookup
+{
+public:
+	PaletteLookup();
+
+	// rgb 0..1 floats, up to 256 entries
+	void				build(const float (*pal)[3], int palSize);
+
+	// built once per palette and shared by everyone using it
+	static std::shared_ptr<const PaletteLookup>	get(const float (*pal)[3], int palSize);
+
+	// r, g, b 0..255
+	uint8_t
+	lookup(int r, int g, int b) const
+	{
+		uint32_t	bucket = myGrid[((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3)];
+
+		if (!(bucket & ListFlag))
+			return (uint8_t)bucket;
+
+		return nearest(r, g, b, &myLists[(bucket & ~ListFlag) >> 8], (bucket & 0xff) + 1);
+	}
+
+	// Palette entries in an order where every aligned run of 2, 4, 8 ...
+	// places is a cluster of similar colours led by its first entry, so a
+	// search can try the first of each run, then the rest of the best run.
+	const uint8_t*		getClusterOrder() const { return myClusterOrder; }
+
+	// place of each entry in getClusterOrder(), 0 past the palette
+	const uint8_t*		getClusterPlace() const { return myClusterPlace; }
+
+	size_t				getMemorySize() const;
+
+private:
+
+	static const int		GridBits = 5;
+	static const int		GridSize = 1 << GridBits;
+	static const uint32_t	ListFlag = 0x80000000u;		// else the entry itself
+
+	uint8_t				nearest(int r, int g, int b, const uint8_t* list, int count) const;
+
+	void				buildClusters();
+	void				orderCluster(uint8_t* entries, int count, int lead);
+	int					nearestToMean(const uint8_t* entries, int count) const;
+
+	// entry, or ListFlag | list offset << 8 | (count - 1)
+	uint32_t			myGrid[GridSize * GridSize * GridSize];
+	std::vector<uint8_t>	myLists;
+
+	float				myPal[256][3];
+	int					myPalSize;
+	float				myLevels[256];		// i / 255
+
+	uint8_t				myClusterOrder[256];
+	uint8_t				myClusterPlace[256];
+};
+
+#endif
@@ -0,0 +1,26 @@
+/*
+
+   Palettes supported by the colorize encoder
+
+*/
+
+#ifndef __PALETTES__
+#define __PALETTES__
+
+enum
+{
+	Palette_Atari2600NTSC = 0,
+	Palette_BW2 = 1,
+	Palette_BW4 = 2,
+	Palette_RGB = 3,
+	Palette_Atari2600RandomTerrain = 4,
+	Palette_Rubik = 5,
+	Palette_Atari2600PAL = 6,
+	Palette_Atari2600SECAM = 7,
+	Palette_ColecoVision = 8,
+};
+
+// 8 bit rgb triplets, palSize entries
+void	getPalette(int palette, unsigned char* &pal, int &palSize);
+
+#endif
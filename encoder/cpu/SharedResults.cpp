@@ -0,0 +1,131 @@
+/*
+
+   Colorize results published in named shared memory
+
+*/
+
+#include "SharedResults.h"
+
+#include <string.h>
+
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+
+SharedResults::SharedResults()
+{
+	myHeader = nullptr;
+	mySize = 0;
+#ifdef _WIN32
+	myMapping = nullptr;
+#endif
+}
+
+SharedResults::~SharedResults()
+{
+	close();
+}
+
+bool
+SharedResults::open(const char *name, int cells, int lines)
+{
+	if (!name || !name[0])
+	{
+		close();
+		return false;
+	}
+
+	uint32_t	size = lines * (2*cells + 1);
+
+	if (myHeader && myName == name && myHeader->cells == (uint32_t)cells && myHeader->lines == (uint32_t)lines)
+		return true;
+
+	close();
+
+	size_t	mapSize = sizeof(SharedResultsHeader) + size;
+	void*	mem = nullptr;
+
+#ifdef _WIN32
+	myMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, (DWORD)mapSize, name);
+	if (!myMapping)
+		return false;
+
+	mem = MapViewOfFile(myMapping, FILE_MAP_ALL_ACCESS, 0, 0, mapSize);
+	if (!mem)
+	{
+		CloseHandle(myMapping);
+		myMapping = nullptr;
+		return false;
+	}
+#else
+	// POSIX names need a leading slash
+	std::string	shmName = name[0] == '/' ? name : std::string("/") + name;
+
+	int fd = shm_open(shmName.c_str(), O_CREAT | O_RDWR, 0644);
+	if (fd < 0)
+		return false;
+
+	if (ftruncate(fd, mapSize) == 0)
+		mem = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+
+	if (!mem || mem == MAP_FAILED)
+		return false;
+#endif
+
+	myName = name;
+	mySize = mapSize;
+	myHeader = new (mem) SharedResultsHeader;
+
+	memcpy(myHeader->magic, "MVCR", 4);
+	myHeader->version = 1;
+	myHeader->sequence.store(0);
+	myHeader->cells = cells;
+	myHeader->lines = lines;
+	myHeader->size = size;
+
+	// nothing valid yet
+	memset((uint8_t*)(myHeader + 1), 0, size);
+	return true;
+}
+
+void
+SharedResults::close()
+{
+	if (!myHeader)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(myHeader);
+	CloseHandle(myMapping);
+	myMapping = nullptr;
+#else
+	munmap(myHeader, mySize);
+#endif
+
+	myHeader = nullptr;
+	mySize = 0;
+	myName.clear();
+}
+
+uint8_t*
+SharedResults::beginWrite()
+{
+	myHeader->sequence.fetch_add(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	return (uint8_t*)(myHeader + 1);
+}
+
+void
+SharedResults::endWrite()
+{
+	myHeader->sequence.fetch_add(1, std::memory_order_release);
+}
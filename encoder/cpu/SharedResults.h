@@ -0,0 +1,65 @@
+/*
+
+   Colorize results published in named shared memory
+
+   Lets another process (or a Script in the network) read each field's
+   packed results as bytes, without going through the Info DAT strings.
+   The block is a SharedResultsHeader followed by the packed record of
+   Colorizer::packResults().
+
+   On Windows the name is a file mapping, eg. from python
+   mmap.mmap(-1, size, tagname=name). Elsewhere it is a POSIX shared
+   memory object, /dev/shm/<name> on Linux.
+
+   sequence is odd while a field is being written. A reader copies the
+   record and keeps it if sequence was the same even number before and
+   after the copy.
+
+*/
+
+#ifndef __SHAREDRESULTS__
+#define __SHAREDRESULTS__
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+
+struct SharedResultsHeader
+{
+	char					magic[4];		// "MVCR"
+	uint32_t				version;		// 1
+	std::atomic<uint32_t>	sequence;		// bumped before and after each write
+	uint32_t				cells;			// bytes per line of graph and color
+	uint32_t				lines;
+	uint32_t				size;			// packed record bytes after the header
+};
+
+class SharedResults
+{
+public:
+	SharedResults();
+	~SharedResults();
+
+	// (re)maps the block when the name or layout changes, an empty name closes it
+	bool				open(const char *name, int cells, int lines);
+	void				close();
+
+	bool				isOpen() const { return myHeader != nullptr; }
+
+	// packed record to fill between beginWrite() and endWrite()
+	uint8_t*			beginWrite();
+	void				endWrite();
+
+private:
+
+	std::string			myName;
+	SharedResultsHeader*	myHeader;
+	size_t				mySize;			// mapped bytes
+#ifdef _WIN32
+	void*				myMapping;
+#endif
+};
+
+#endif
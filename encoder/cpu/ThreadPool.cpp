@@ -0,0 +1,103 @@
+/*
+
+   Fixed size pool of worker threads
+
+*/
+
+#include "ThreadPool.h"
+
+
+ThreadPool::ThreadPool(int numThreads)
+{
+	if (numThreads < 1)
+		numThreads = 1;
+
+	myNumThreads = numThreads;
+	myFunc = nullptr;
+	myCount = 0;
+	myNext = 0;
+	myBusy = 0;
+	myGeneration = 0;
+	myQuit = false;
+
+	for (int i=1; i<numThreads; i++)
+		myWorkers.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex>	lock(myMutex);
+		myQuit = true;
+	}
+	myStart.notify_all();
+
+	for (auto& worker : myWorkers)
+		worker.join();
+}
+
+void
+ThreadPool::runJobs(int thread)
+{
+	for (int i = myNext++; i < myCount; i = myNext++)
+		(*myFunc)(i, thread);
+}
+
+void
+ThreadPool::workerLoop(int thread)
+{
+	unsigned	generation = 0;
+
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex>	lock(myMutex);
+			myStart.wait(lock, [&]() { return myQuit || myGeneration != generation; });
+
+			if (myQuit)
+				return;
+
+			generation = myGeneration;
+		}
+
+		runJobs(thread);
+
+		{
+			std::lock_guard<std::mutex>	lock(myMutex);
+			if (--myBusy == 0)
+				myDone.notify_one();
+		}
+	}
+}
+
+void
+ThreadPool::parallelFor(int count, const std::function<void(int, int)>& func)
+{
+	if (count <= 0)
+		return;
+
+	// not worth waking anyone up
+	if (myWorkers.empty() || count == 1)
+	{
+		for (int i=0; i<count; i++)
+			func(i, 0);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex>	lock(myMutex);
+		myFunc = &func;
+		myCount = count;
+		myNext = 0;
+		myBusy = (int)myWorkers.size();
+		myGeneration++;
+	}
+	myStart.notify_all();
+
+	runJobs(0);
+
+	// wait for the workers to finish their last index
+	std::unique_lock<std::mutex>	lock(myMutex);
+	myDone.wait(lock, [&]() { return myBusy == 0; });
+	myFunc = nullptr;
+}
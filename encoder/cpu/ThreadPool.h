@@ -0,0 +1,53 @@
+/*
+
+   Fixed size pool of worker threads
+
+   parallelFor() hands out indices to the workers and the calling
+   thread, and returns once every index has been processed.
+
+*/
+
+#ifndef __THREADPOOL__
+#define __THREADPOOL__
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+class ThreadPool
+{
+public:
+	// numThreads includes the calling thread
+	ThreadPool(int numThreads);
+	~ThreadPool();
+
+	int					getNumThreads() const { return myNumThreads; }
+
+	// func(index, thread) for index 0..count-1, thread 0..getNumThreads()-1
+	void				parallelFor(int count, const std::function<void(int, int)>& func);
+
+private:
+
+	void				workerLoop(int thread);
+	void				runJobs(int thread);
+
+	int					myNumThreads;
+	std::vector<std::thread>	myWorkers;
+
+	std::mutex			myMutex;
+	std::condition_variable	myStart;
+	std::condition_variable	myDone;
+
+	const std::function<void(int, int)>*	myFunc;
+	int					myCount;
+	std::atomic<int>	myNext;
+	int					myBusy;
+	unsigned			myGeneration;
+	bool				myQuit;
+};
+
+#endif
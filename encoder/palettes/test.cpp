@@ -1,20 +1,19 @@
+/*
+
+   Writes the nearest palette entry of every 8 bit rgb colour
 
+   g++ -O2 -std=c++11 test.cpp ../cpu/ColorKernels.cpp -lpthread
 
+*/
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
 
+#include <thread>
+#include <vector>
 
-// kd-tree structures
-/* Adapted from: https://rosettacode.org/wiki/K-d_tree */
-#define MAX_DIM 3
+#include "../cpu/ColorKernels.h"
 
-struct kd_node_t
-{
-    float   val[MAX_DIM];
-    int     index;
-    struct  kd_node_t *left, *right;
-};
 
 template<class T>
 class Array2D
@@ -97,192 +96,6 @@ private:
 
 };
 
-// k-d tree data
-struct kd_node_t	kdtree[256];
-struct kd_node_t*	kdtree_root{nullptr};
-void				setup_kdtree(Array2D<float[3]>& fpal, int palSize);
-
-
-const float	colorScales[3] = {0.299f, 0.587f, 0.114f};
-
-float
-colorDist(const float a[3], const float b[3])
-{
-	float dist =
-		(a[0] - b[0])*(a[0] - b[0]) * colorScales[0] +
-		(a[1] - b[1])*(a[1] - b[1]) * colorScales[1] +
-		(a[2] - b[2])*(a[2] - b[2]) * colorScales[2];
-	
-	return dist;
-}
-
-/////////////////////////////////////////////////////////
-/* Adapted from: https://rosettacode.org/wiki/K-d_tree */
-
- 
-inline float
-dist(struct kd_node_t *a, struct kd_node_t *b)
-{
-	return colorDist(a->val, b->val);
-}
-
-inline void
-swap_nodes(struct kd_node_t *x, struct kd_node_t *y) 
-{
-	kd_node_t	tmp;
-
-	tmp.val[0] = x->val[0];
-	tmp.val[1] = x->val[1];
-	tmp.val[2] = x->val[2];
-	tmp.index = x->index;
-
-	x->val[0] = y->val[0];
-	x->val[1] = y->val[1];
-	x->val[2] = y->val[2];
-	x->index = y->index;
-
-	y->val[0] = tmp.val[0];
-	y->val[1] = tmp.val[1];
-	y->val[2] = tmp.val[2];
-	y->index = tmp.index;
-}
- 
- 
-/* see quickselect method */
-static struct kd_node_t*
-find_median(struct kd_node_t *start, struct kd_node_t *end, int idx)
-{
-    if (end <= start)
-		return nullptr;
-
-    if (end == start + 1)
-        return start;
- 
-    struct kd_node_t *p, *store, *md = start + (end - start) / 2;
-
-    while (1) 
-	{
-		float pivot = md->val[idx];
- 
-        swap_nodes(md, end - 1);
-        for (store = p = start; p < end; p++) 
-		{
-            if (p->val[idx] < pivot) 
-			{
-                if (p != store)
-                    swap_nodes(p, store);
-                store++;
-            }
-        }
-        swap_nodes(store, end - 1);
- 
-        /* median has duplicate values */
-        if (store->val[idx] == md->val[idx])
-            return md;
- 
-        if (store > md)
-			end = store;
-        else
-			start = store;
-    }
-}
- 
-static struct kd_node_t*
-make_tree(struct kd_node_t *t, long len, int i)
-{
-    struct kd_node_t *n;
- 
-    if (!len)
-		return 0;
- 
-    if ((n = find_median(t, t + len, i))) 
-	{
-        i = (i + 1) % MAX_DIM;
-        n->left  = make_tree(t, n - t, i);
-        n->right = make_tree(n + 1, t + len - (n + 1), i);
-    }
-    return n;
-}
- 
- 
-static void
-nearest(struct kd_node_t *root, struct kd_node_t *nd, int i,
-        struct kd_node_t **best, float *best_dist)
-{
-    float d, dx, dx2;
- 
-    if (!root)
-		return;
-
-    d = dist(root, nd);
-    dx = root->val[i] - nd->val[i];
-
-    dx2 = dx * dx;
-
-	dx2 *= colorScales[i];
-
-    if (!*best || d < *best_dist) 
-	{
-        *best_dist = d;
-        *best = root;
-    }
- 
-    /* if chance of exact match is high */
-    if (!*best_dist)
-		return;
- 
-    if (++i >= MAX_DIM)
-		i = 0;
- 
-    nearest(dx > 0 ? root->left : root->right, nd, i, best, best_dist);
-
-    if (dx2 >= *best_dist)
-		return;
-
-    nearest(dx > 0 ? root->right : root->left, nd, i, best, best_dist);
-}
- 
-void
-setup_kdtree(Array2D<float[3]>& fpal, int palSize)
-{
-	if (palSize > 256)
-		palSize = 256;
-
-    for (int i=0; i<palSize; i++)
-    {
-		kd_node_t	&n = kdtree[i];
-
-        n.val[0] = fpal(i,0)[0];
-        n.val[1] = fpal(i,0)[1];
-        n.val[2] = fpal(i,0)[2];
-		n.index = i;
-	}
-
-    kdtree_root = make_tree(kdtree, palSize, 0);
-}
-
-static int
-search_kdtree(float r, float g, float b, kd_node_t* root)
-{
-	kd_node_t	n;
-
-	n.val[0] = r;
-	n.val[1] = g;
-	n.val[2] = b;
-
-    struct kd_node_t *found = nullptr;
-    float best_dist;
-
-    nearest(root, &n, 0, &found, &best_dist);
-
-	if (found)
-		return found->index;
-
-	return -1;
-}
-
-/*              end of kd -tree                        */
-/////////////////////////////////////////////////////////
 
 
 unsigned char
@@ -973,7 +786,6 @@ execute(int palIndex, const char* filenameBase)
     int             palSize;
 
     Array2D<float[3]>	myFPal;
-    uint8_t				myColorLookup[256][256][256];
 
     getPalette(palIndex, pal, palSize);
 
@@ -1001,7 +813,72 @@ execute(int palIndex, const char* filenameBase)
 		fclose(output_pal);
 
 
-        setup_kdtree(myFPal, palSize);
+		// palette as r, g, b planes for the nearest colour search
+		float		palPlanes[3][256] = {};
+		uint8_t		entries[256];
+
+		for (int i=0; i<palSize; i++)
+		{
+			palPlanes[0][i] = myFPal(i, 0)[0];
+			palPlanes[1][i] = myFPal(i, 0)[1];
+			palPlanes[2][i] = myFPal(i, 0)[2];
+			entries[i] = i;
+		}
+
+		// split the red slabs over threads
+		std::vector<uint8_t>	lookup(256 * 256 * 256);
+
+		int		numThreads = std::thread::hardware_concurrency();
+		if (numThreads < 1)
+			numThreads = 1;
+
+		auto buildSlabs = [&](int first)
+		{
+			float	levels[256];
+			float	rr[256];
+			float	gg[256];
+
+			for (int i = 0; i < 256; i++)
+				levels[i] = i / 255.0f;
+
+			for (int r = first; r < 256; r += numThreads) 
+			{
+				for (int g = 0; g < 256; g++) 
+				{
+					// a row of blues at a time
+					for (int b = 0; b < 256; b++) 
+					{
+						rr[b] = levels[r];
+						gg[b] = levels[g];
+					}
+
+					nearestColors(rr, gg, levels, 256, palPlanes, entries, palSize,
+								  &lookup[(r*256 + g)*256]);
+				}
+			}
+		};
+
+		std::vector<std::thread>	threads;
+		for (int t = 1; t < numThreads; t++)
+			threads.push_back(std::thread(buildSlabs, t));
+
+		buildSlabs(0);
+
+		for (auto& thread : threads)
+			thread.join();
+
+		{
+			int		r = 50, g = 46, b = 34;
+			int		minIndex = lookup[(r*256 + g)*256 + b];
+
+			fprintf(stderr, "%d %d %d -> %d ", r, g, b, minIndex);
+
+			float fr = myFPal(minIndex, 0)[0];
+			float fg = myFPal(minIndex, 0)[1];
+			float fb = myFPal(minIndex, 0)[2];
+
+			fprintf(stderr, "pal %g %g %g \n", fr, fg, fb);
+		}
 
 		char	filenameTxt[128];
 		sprintf(filenameTxt,"%s.chan", filenameBase);
@@ -1013,40 +890,34 @@ execute(int palIndex, const char* filenameBase)
 		FILE*	output_txt = fopen(filenameTxt, "w");
 		FILE*	output_bin = fopen(filenameBin, "wb");
 
+		fwrite(lookup.data(), 1, lookup.size(), output_bin);
+
+		// format a red slab at a time, " %d" per entry and a line per green
+		std::vector<char>	text(256 * (256*4 + 1));
+
 		for (int r = 0; r < 256; r++) 
 		{
+			char*			out = text.data();
+			const uint8_t*	in = &lookup[r*256*256];
+
 			for (int g = 0; g < 256; g++) 
 			{
 				for (int b = 0; b < 256; b++) 
 				{
-					float rr = r / 255.0f;
-					float gg = g / 255.0f;
-					float bb = b / 255.0f;
-									
-					int		minIndex = search_kdtree(rr, gg, bb, kdtree_root);
-
-					fprintf(output_txt, " %d", minIndex);
-					
-					uint8_t c = (uint8_t)minIndex;
-					fwrite(&c, 1, sizeof(c), output_bin);
-//					fprintf(output_bin, " %c", (uint8_t)minIndex);
-
-					if (r == 50 && g == 46 && b == 34)
-					{
-						fprintf(stderr, "%d %d %d -> %d ", r, g, b, minIndex);
-
-						float fr = myFPal(minIndex, 0)[0];
-						float fg = myFPal(minIndex, 0)[1];
-						float fb = myFPal(minIndex, 0)[2];
-
-						fprintf(stderr, "pal %g %g %g \n", fr, fg, fb);
-					}
-
-//					myColorLookup[r][g][b] = minIndex;
+					int		v = *in++;
+
+					*out++ = ' ';
+					if (v >= 100)
+						*out++ = '0' + v / 100;
+					if (v >= 10)
+						*out++ = '0' + (v / 10) % 10;
+					*out++ = '0' + v % 10;
 				}
 
-				fprintf(output_txt, "\n");
+				*out++ = '\n';
 			}
+
+			fwrite(text.data(), 1, out - text.data(), output_txt);
 		}
 
 		fclose(output_txt);
@@ -1054,7 +925,7 @@ execute(int palIndex, const char* filenameBase)
     }
 }
 
-void
+int
 main(void)
 {
 	execute(Palette_Atari2600NTSC, "Atari2600NTSC_lookup");
@@ -1068,6 +939,8 @@ main(void)
 	execute(Palette_RGB, "RGB");
 	execute(Palette_Rubik, "Rubik");
 #endif
+
+	return 0;
 }
 
 